@@ -1,160 +1,318 @@
 
 #include "app.h"
 #include "ui_app.h"
+#include "costengine.h"
 #include "database.h"
+#include "dbnotifier.h"
+#include "dbtrace.h"
+#include "dbworker.h"
+#include "models.h"
+#include "nameindex.h"
 #include "nametoiddelegate.h"
+#include "optimizer.h"
+#include "scenario.h"
 #include "currencydelegate.h"
 
-#include <QSqlField>
-#include <QSqlRecord>
-#include <QSqlQuery>
-#include <QSqlQueryModel>
-#include <QSqlTableModel>
-#include <QStringListModel>
 #include <QCompleter>
-#include <QSqlError>
+#include <QFileDialog>
+#include <QInputDialog>
+#include <QLocale>
 #include <QMessageBox>
+#include <QTableView>
+#include <QVBoxLayout>
 
 namespace
 {
   const int groceries_tab_idx = 0;
+  const int recipes_tab_idx = 1;
+  const int foods_tab_idx = 2;
   const int recipe_tab_idx = 3;
+  const int stats_tab_idx = 4;
+  // past this many foods, planned groceries are regenerated instead
+  const int update_foods_limit = 1000;
+  // tables the cost engine holds
+  const QStringList cost_sources = {"recipes", "ingredients", "foods"};
 
-  bool confirmed(QWidget *parent, QString description)
+  struct ScenarioReport
   {
-    QMessageBox::StandardButton reply;
-    reply = QMessageBox::question(parent, description, "Are you sure?", QMessageBox::Yes|QMessageBox::No);
-    return reply == QMessageBox::Yes;
-  }
+    // false when the scenarios file could not be read
+    bool read = false;
+    QList<ScenarioResult> results;
+  };
 
-  QList<int> table_remove_rows(QItemSelectionModel *select, QSqlTableModel *model, int id_column)
+  // Folds changes into into, table by table
+  void merge_changes(DbChanges &into, const DbChanges &changes)
   {
-    QList<int> removed;
-    if (!select->hasSelection())
-      return removed;
-    auto indexes = select->selectedRows(id_column);
-    for (auto index : indexes)
+    for (auto i = changes.constBegin(); i != changes.constEnd(); ++i)
     {
-      if (model->removeRows(index.row(), 1))
-        removed.append(index.data().toInt());
+      DbTableChanges &table = into[i.key()];
+      table.reset = table.reset || i.value().reset;
+      table.inserted.unite(i.value().inserted);
+      table.updated.unite(i.value().updated);
+      table.deleted.unite(i.value().deleted);
     }
-    return removed;
   }
 
-  void query_refresh(QSqlQueryModel *model)
+  bool confirmed(QWidget *parent, QString description)
   {
-    QString str = model->query().executedQuery();
-    model->query().clear();
-    model->setQuery(str);
+    QMessageBox::StandardButton reply;
+    reply = QMessageBox::question(parent, description, "Are you sure?", QMessageBox::Yes|QMessageBox::No);
+    return reply == QMessageBox::Yes;
+  }
+
+  template <typename Model>
+  Model *create_model(QAbstractItemView *view, QObject *parent)
+  {
+    auto model = new Model(parent);
+    model->reload();
+    view->setModel(model);
+    return model;
   }
 
-  QList<int> query_remove_ids(QItemSelectionModel *select, QString table, int id_column)
+  // Removes the selected rows on the worker, then runs done with their ids,
+  // or shows why nothing was removed
+  void query_remove_ids(QWidget *parent, QItemSelectionModel *select, QString table, int id_column, std::function<void(QList<int>)> done = nullptr)
   {
+    if (!select || !select->hasSelection())
+      return;
     QList<int> removed;
-    if (!select->hasSelection())
-      return removed;
     auto indexes = select->selectedRows(id_column);
     for (auto index : indexes)
     {
       QVariant var = index.data();
-      if (var.isNull())
-        continue;
-      if (db_remove_id(table, var.toInt()))
+      if (!var.isNull())
         removed.append(var.toInt());
     }
-    return removed;
+    if (removed.isEmpty())
+      return;
+    db_post<QString>(QString(), [table, removed]()
+    {
+      QString error;
+      if (db_remove_ids(table, removed, &error))
+        return QString();
+      return error.isEmpty() ? QString("unknown error") : error;
+    },
+    parent,
+    [parent, table, removed, done](QString error)
+    {
+      if (!error.isEmpty())
+        QMessageBox::warning(parent, "Remove", QString("Nothing was removed from %1: %2").arg(table).arg(error));
+      else if (done)
+        done(removed);
+    });
   }
 }
 
 struct App::Impl
 {
   App *app;
-  QSqlQueryModel *planned;
-  QSqlTableModel *groceries;
-  QSqlQueryModel *recipes;
-  QSqlTableModel *foods;
-  QSqlTableModel *ingredients;
-  QSqlQueryModel *estimates;
+  // created when their tab is first shown
+  PlannedModel *planned = nullptr;
+  GroceriesModel *groceries = nullptr;
+  RecipesModel *recipes = nullptr;
+  RecipeSearchModel *recipe_search = nullptr;
+  SuggestionsModel *suggestions = nullptr;
+  // loaded on a read thread with the groceries or recipes tab, and patched
+  // from reads there
+  std::shared_ptr<CostEngine> costs;
+  bool costs_loading = false;
+  bool costs_reading = false;
+  // notifications not yet read into costs, folded together, and whether
+  // the planned groceries of any of them wait on that
+  DbChanges costs_changes;
+  bool costs_groceries = false;
+  FoodsModel *foods = nullptr;
+  IngredientsModel *ingredients = nullptr;
+  EstimatesModel *estimates = nullptr;
+  TraceModel *trace = nullptr;
   CurrencyDelegate *currency_delegate;
-  QCompleter *food_completer = nullptr;
-  QCompleter *recipe_completer = nullptr;
+  NameIndex *unit_names;
+  NameIndex *food_names;
+  NameIndex *recipe_names;
   int recipe_id = -1;
+  // foods whose planned groceries are waiting on the worker
+  QSet<int> pending_foods;
 
   Impl(App *app_) :
     app(app_),
-    planned(new QSqlQueryModel(app)),
-    groceries(new QSqlTableModel(app)),
-    recipes(new QSqlQueryModel(app)),
-    foods(new QSqlTableModel(app)),
-    ingredients(new QSqlTableModel(app)),
-    estimates(new QSqlQueryModel(app)),
-    currency_delegate(new CurrencyDelegate(app))
-  {
-    planned->setQuery("select id, name from recipes where planned != 0");
-
-    groceries->setEditStrategy(QSqlTableModel::OnFieldChange);
-    groceries->setTable("groceries");
-    groceries->select();
-
-    recipes->setQuery(
-        "select"
-        " r.id,"
-        " r.name,"
-        " sum(case f.staple when 1 then f.price else 0 end) as staples, "
-        " sum(case f.staple when 0 then i.quantity * f.price else 0 end) as fresh "
-        "from recipes r"
-        " left outer join ingredients i on r.id = i.recipe"
-        " left outer join foods f on f.id = i.food "
-        "group by r.id"
-        );
-
-    foods->setEditStrategy(QSqlTableModel::OnFieldChange);
-    foods->setTable("foods");
-    foods->select();
-
-    ingredients->setEditStrategy(QSqlTableModel::OnFieldChange);
-    ingredients->setTable("ingredients");
-    ingredients->setFilter("recipe is null");
-
-    groceries->setEditStrategy(QSqlTableModel::OnFieldChange);
-    groceries->setTable("groceries");
-    groceries->select();
-
-    estimates->setQuery(
-        "select"
-        " sum(g.quantity * f.price) as total,"
-        " sum(case f.staple when 1 then (g.quantity * f.price) else 0 end) as staples, "
-        " sum(case f.staple when 0 then (g.quantity * f.price) else 0 end) as fresh "
-        "from groceries g join foods f on f.id = g.food"
-        );
-  }
-
-  ~Impl()
-  {
-    if (food_completer)
-      delete food_completer;
-    if (recipe_completer)
-      delete recipe_completer;
-  }
-
-  void reset_recipe_completer()
-  {
-    auto old = recipe_completer;
-    recipe_completer = new QCompleter(db_recipe_names());
-    recipe_completer->setCompletionMode(QCompleter::InlineCompletion);
-    recipe_completer->setCaseSensitivity(Qt::CaseInsensitive);
-    app->ui->lePlanned->setCompleter(recipe_completer);
-    if (old)
-      delete old;
-    auto delegate = qobject_cast<NameToIdDelegate*>(app->ui->plannedView->itemDelegate());
-    delegate->reset(db_recipe_id_map());
+    currency_delegate(new CurrencyDelegate(app)),
+    unit_names(new NameIndex("units", app)),
+    food_names(new NameIndex("foods", app)),
+    recipe_names(new NameIndex("recipes", app))
+  {
+  }
+
+  void load_costs()
+  {
+    if (costs || costs_loading)
+      return;
+    reload_costs();
+  }
+
+  // Loads a fresh engine and switches to it when it lands
+  void reload_costs()
+  {
+    costs_loading = true;
+    db_read<std::shared_ptr<CostEngine>>([]()
+    {
+      auto engine = std::make_shared<CostEngine>();
+      engine->load();
+      return engine;
+    },
+    app,
+    [this](std::shared_ptr<CostEngine> engine)
+    {
+      costs_loading = false;
+      costs = engine;
+      set_costs();
+      // the load may already hold some of these; the patch rereads what they touch
+      patch_costs();
+    });
+  }
+
+  // Reads the waiting changes on a read thread and patches costs with them
+  // when the read lands, one read at a time so patches apply in order
+  void patch_costs()
+  {
+    if (!costs || costs_loading || costs_reading || costs_changes.isEmpty())
+      return;
+    DbChanges changes;
+    changes.swap(costs_changes);
+    bool groceries = costs_groceries;
+    costs_groceries = false;
+    DbTableChanges recipe_changes = changes.value("recipes");
+    DbTableChanges ingredient_changes = changes.value("ingredients");
+    QSet<int> affected;
+    if (groceries)
+      affected = costs->planned_foods(ingredient_changes.updated + ingredient_changes.deleted, recipe_changes.deleted);
+    costs_reading = true;
+    std::shared_ptr<CostEngine> engine = costs;
+    db_read<std::shared_ptr<CostPatch>>([engine, changes]()
+    {
+      return engine->read(changes);
+    },
+    app,
+    [this, groceries, ingredient_changes, affected](std::shared_ptr<CostPatch> patch) mutable
+    {
+      costs_reading = false;
+      if (!patch)
+      {
+        reload_costs();
+        return;
+      }
+      costs->patch(*patch);
+      if (planned)
+        planned->repriced();
+      if (recipes)
+        recipes->repriced();
+      if (suggestions)
+        suggestions->repriced();
+      if (groceries)
+      {
+        affected.unite(costs->planned_foods(ingredient_changes.inserted + ingredient_changes.updated, QSet<qint64>()));
+        if (affected.size() > update_foods_limit)
+          regenerate_planned_groceries();
+        else
+          update_planned_groceries(affected.values());
+      }
+      patch_costs();
+    });
+  }
+
+  void set_costs()
+  {
+    if (!costs)
+      return;
+    if (planned)
+      planned->set_costs(costs.get());
+    if (suggestions)
+      suggestions->set_costs(costs);
+    if (recipes)
+      recipes->set_costs(costs.get());
+  }
+
+  void show_tab(int index)
+  {
+    auto ui = app->ui;
+    if (index == groceries_tab_idx && !groceries)
+    {
+      planned = create_model<PlannedModel>(ui->plannedView, app);
+      groceries = create_model<GroceriesModel>(ui->groceriesView, app);
+      estimates = create_model<EstimatesModel>(ui->estimatesView, app);
+      suggestions = new SuggestionsModel(recipe_names, app);
+      ui->suggestionsView->setModel(suggestions);
+      ui->suggestionsView->setItemDelegateForColumn(2, currency_delegate);
+      if (costs)
+      {
+        planned->set_costs(costs.get());
+        suggestions->set_costs(costs);
+      }
+      load_costs();
+#ifdef QT_NO_DEBUG
+      ui->groceriesView->hideColumn(0);
+      ui->groceriesView->hideColumn(3);
+      ui->plannedView->hideColumn(0);
+      ui->suggestionsView->hideColumn(0);
+#endif
+    }
+    else if (index == recipes_tab_idx && !recipes)
+    {
+      recipes = create_model<RecipesModel>(ui->recipesView, app);
+      if (costs)
+        recipes->set_costs(costs.get());
+      load_costs();
+#ifdef QT_NO_DEBUG
+      ui->recipesView->hideColumn(0);
+#endif
+    }
+    else if (index == foods_tab_idx && !foods)
+    {
+      foods = create_model<FoodsModel>(ui->foodsView, app);
+#ifdef QT_NO_DEBUG
+      ui->foodsView->hideColumn(0);
+#endif
+    }
+    else if (index == recipe_tab_idx && !ingredients)
+    {
+      ingredients = create_model<IngredientsModel>(ui->ingredientsView, app);
+#ifdef QT_NO_DEBUG
+      ui->ingredientsView->hideColumn(0);
+      ui->ingredientsView->hideColumn(1);
+#endif
+    }
+    else if (index == stats_tab_idx)
+    {
+      if (!trace)
+      {
+        trace = new TraceModel(app);
+        ui->statsView->setModel(trace);
+      }
+      refresh_stats();
+    }
+  }
+
+  void refresh_stats()
+  {
+    trace->refresh();
+    DbReaderPoolStats readers = db_reader_pool_stats();
+    app->ui->readerPoolLabel->setText(
+        QString("Readers: %1 open, %2 in use, peak %3 of %4, %5 checkouts, %6 waits (%7 ms)")
+        .arg(readers.open).arg(readers.in_use).arg(readers.peak).arg(readers.size)
+        .arg(readers.checkouts).arg(readers.waits).arg(readers.wait_ns / 1e6, 0, 'f', 1));
+  }
+
+  void export_stats()
+  {
+    QString path = QFileDialog::getSaveFileName(app, "Export Stats", "trace.json", "JSON (*.json)");
+    if (!path.isEmpty() && !db_trace_write(path))
+      QMessageBox::warning(app, "Export Stats", "Unable to write " + path);
   }
 
   void reset_recipe_tab()
   {
     recipe_id = -1;
-    ingredients->setFilter("recipe is null");
-    ingredients->select();
+    if (ingredients)
+      ingredients->set_recipe(-1);
     app->ui->leRecipeTitle->clear();
     app->ui->teRecipeSteps->clear();
     app->ui->recipeTab->setEnabled(false);
@@ -164,22 +322,38 @@ struct App::Impl
   {
     if (recipe_id >= 0)
       reset_recipe_tab();
-    ingredients->setFilter(QString("recipe = %1").arg(id));
-    app->ui->leRecipeTitle->setText(db_recipe_name(id));
-    app->ui->teRecipeSteps->setPlainText(db_recipe_steps(id));
-    app->ui->recipeTab->setEnabled(true);
+    show_tab(recipe_tab_idx);
+    ingredients->set_recipe(id);
     app->ui->tabs->setCurrentIndex(recipe_tab_idx);
     recipe_id = id;
+    // editable once its name and steps are read
+    db_read<QStringList>([id]()
+    {
+      return QStringList{db_recipe_name(id), db_recipe_steps(id)};
+    },
+    app,
+    [this, id](QStringList recipe)
+    {
+      if (recipe_id != id)
+        return;
+      app->ui->leRecipeTitle->setText(recipe[0]);
+      app->ui->teRecipeSteps->setPlainText(recipe[1]);
+      app->ui->recipeTab->setEnabled(true);
+    });
   }
 
   void start_add_recipe(QString name)
   {
-    int id = db_add_recipe(name);
-    if (id >= 0)
+    db_post<int>(QString(), [name]()
     {
-      start_edit_recipe(id);
-      reset_recipe_completer();
-    }
+      return db_add_recipe(name);
+    },
+    app,
+    [this](int id)
+    {
+      if (id >= 0)
+        start_edit_recipe(id);
+    });
   }
 
   void stop_edit_recipe()
@@ -188,157 +362,357 @@ struct App::Impl
       return;
     QString name = app->ui->leRecipeTitle->text();
     QString steps = app->ui->teRecipeSteps->toPlainText();
-    db_set_recipe_name(recipe_id, name);
-    db_set_recipe_steps(recipe_id, steps);
+    int id = recipe_id;
+    db_post(QString("recipe:%1").arg(id), [id, name, steps]()
+    {
+      db_set_recipe_name(id, name);
+      db_set_recipe_steps(id, steps);
+    });
     reset_recipe_tab();
-    query_refresh(recipes);
-    reset_recipe_completer();
     app->ui->tabs->setCurrentIndex(groceries_tab_idx);
   }
 
-  void remove_selected_recipes()
+  // Shows ranked matches in recipesView while text is not blank
+  void search_recipes(QString text)
   {
-    auto select = app->ui->recipesView->selectionModel();
-    QList<int> removed = query_remove_ids(select, "recipes", 0);
-    if (removed.contains(recipe_id))
-      reset_recipe_tab();
-    if (removed.size() > 0)
+    auto view = app->ui->recipesView;
+    if (text.trimmed().isEmpty())
     {
-      query_refresh(recipes);
-      reset_recipe_completer();
+      if (recipe_search)
+        recipe_search->search(QString());
+      if (view->model() != recipes)
+        view->setModel(recipes);
     }
+    else
+    {
+      if (!recipe_search)
+        recipe_search = new RecipeSearchModel(app);
+      recipe_search->search(text);
+      if (view->model() != recipe_search)
+        view->setModel(recipe_search);
+    }
+#ifdef QT_NO_DEBUG
+    view->hideColumn(0);
+#endif
   }
 
-  void reset_food_completer()
+  void remove_selected_recipes()
   {
-    auto old = food_completer;
-    food_completer = new QCompleter(db_food_names());
-    food_completer->setCompletionMode(QCompleter::InlineCompletion);
-    food_completer->setCaseSensitivity(Qt::CaseInsensitive);
-    app->ui->leIngredient->setCompleter(food_completer);
-    app->ui->leGrocery->setCompleter(food_completer);
-    if (old)
-      delete old;
-    auto delegate = qobject_cast<NameToIdDelegate*>(app->ui->ingredientsView->itemDelegateForColumn(2));
-    delegate->reset(db_food_id_map());
-    delegate = qobject_cast<NameToIdDelegate*>(app->ui->groceriesView->itemDelegateForColumn(1));
-    delegate->reset(db_food_id_map());
+    auto select = app->ui->recipesView->selectionModel();
+    query_remove_ids(app, select, "recipes", 0, [this](QList<int> removed)
+    {
+      if (removed.contains(recipe_id))
+        reset_recipe_tab();
+    });
   }
 
-  bool add_food(QString name)
+  void add_food(QString name)
   {
-    QSqlRecord record;
-    record.append(QSqlField("name", QVariant::String));
-    record.setValue("name", name);
-    if (foods->insertRecord(-1, record))
+    db_post<bool>(QString(), [name]()
     {
-      reset_food_completer();
-      return true;
-    }
-    return false;
+      return db_add_food(name) >= 0;
+    },
+    app,
+    [this](bool added)
+    {
+      if (added)
+        app->ui->leFood->clear();
+    });
   }
 
   void remove_selected_foods()
   {
-    QList<int> removed = table_remove_rows(app->ui->foodsView->selectionModel(), foods, 0);
-    if (removed.size() > 0)
+    query_remove_ids(app, app->ui->foodsView->selectionModel(), "foods", 0);
+  }
+
+  void add_ingredient(int recipe, QString name)
+  {
+    db_post<bool>(QString(), [recipe, name]()
     {
-      foods->select();
-      reset_food_completer();
-    }
+      int food_id = db_food_id(name);
+      if (food_id < 0 && !name.isEmpty())
+      {
+        if (db_add_food(name) < 0)
+          return false;
+        food_id = db_food_id(name);
+        if (food_id < 0)
+          return false;
+      }
+      return db_add_ingredient(recipe, food_id) >= 0;
+    },
+    app,
+    [this](bool added)
+    {
+      if (added)
+        app->ui->leIngredient->clear();
+    });
   }
 
-  bool add_ingredient(int recipe, QString name)
+  void remove_selected_ingredients()
+  {
+    query_remove_ids(app, app->ui->ingredientsView->selectionModel(), "ingredients", 0);
+  }
+
+  void add_grocery(QString name)
   {
-    int food_id = db_food_id(name);
-    if (food_id < 0 && !name.isEmpty())
+    db_post<bool>(QString(), [name]()
     {
-      if (!add_food(name))
-        return false;
-      food_id = db_food_id(name);
+      int food_id = db_food_id(name);
       if (food_id < 0)
-        return false;
-    }
+      {
+        if (db_add_food(name) < 0)
+          return false;
+        food_id = db_food_id(name);
+        if (food_id < 0)
+          return false;
+      }
+      return db_add_grocery(food_id, 1.0) >= 0;
+    },
+    app,
+    [this](bool added)
+    {
+      if (added)
+        app->ui->leGrocery->clear();
+    });
+  }
 
-    QSqlRecord record;
-    record.append(QSqlField("recipe", QVariant::Int));
-    record.append(QSqlField("food", QVariant::Int));
-    record.setValue("recipe", recipe);
-    record.setValue("food", food_id);
-    return ingredients->insertRecord(-1, record);
+  void remove_selected_groceries()
+  {
+    query_remove_ids(app, app->ui->groceriesView->selectionModel(), "groceries", 0);
   }
 
-  void remove_selected_ingredients()
+  void regenerate_planned_groceries()
   {
-    QList<int> removed = table_remove_rows(app->ui->ingredientsView->selectionModel(), ingredients, 0);
-    if (removed.size() > 0)
-      ingredients->select();
+    db_post("regenerate", []()
+    {
+      db_clear_planned_groceries();
+      db_generate_planned_groceries();
+      db_rebuild_grocery_totals();
+    });
   }
 
-  bool add_grocery(QString name)
+  // Queued updates are replaced by one covering every pending food
+  void update_planned_groceries(QList<int> foods)
   {
-    int food_id = db_food_id(name);
-    if (food_id < 0)
+    if (foods.isEmpty())
+      return;
+    for (int food : foods)
+      pending_foods.insert(food);
+    QList<int> all = pending_foods.values();
+    db_post<bool>("update_planned_groceries", [all]()
     {
-      if (!add_food(name))
-        return false;
-      food_id = db_food_id(name);
-      if (food_id < 0)
-        return false;
-    }
+      return db_update_planned_groceries(all);
+    },
+    app,
+    [this, all](bool)
+    {
+      for (int food : all)
+        pending_foods.remove(food);
+    });
+  }
 
-    QSqlRecord record;
-    record.append(QSqlField("food", QVariant::Int));
-    record.append(QSqlField("quantity", QVariant::Double));
-    record.setValue("food", food_id);
-    record.setValue("quantity", 1.0);
-    if( groceries->insertRecord(-1, record))
+  void update_food_groceries(const DbTableChanges &changes)
+  {
+    if (changes.reset)
     {
-      query_refresh(estimates);
-      return true;
+      regenerate_planned_groceries();
+      return;
     }
-    return false;
+    QList<int> affected;
+    for (qint64 food : changes.updated)
+      affected.append(food);
+    update_planned_groceries(affected);
   }
 
-  void remove_selected_groceries()
+  // Queues changes for the cost engine, which updates the planned
+  // groceries of the foods planned recipes held before or hold after any
+  // ingredient change or recipe delete, whichever connection made it.
+  // Planning and unplanning update their own groceries.
+  void apply_costs(const DbChanges &changes)
   {
-    QList<int> removed = table_remove_rows(app->ui->groceriesView->selectionModel(), groceries, 0);
-    if (removed.size() > 0)
+    bool recipes_changed = changes.contains("recipes") || changes.contains("ingredients");
+    DbTableChanges recipes = changes.value("recipes");
+    DbTableChanges ingredients = changes.value("ingredients");
+    if (recipes_changed && (!costs || recipes.reset || ingredients.reset))
     {
-      groceries->select();
-      query_refresh(estimates);
+      regenerate_planned_groceries();
+      recipes_changed = false;
     }
+    if (!costs && !costs_loading)
+      return;
+    bool touched = false;
+    for (auto source : cost_sources)
+      touched = touched || changes.contains(source);
+    if (!touched)
+      return;
+    merge_changes(costs_changes, changes);
+    costs_groceries = costs_groceries || recipes_changed;
+    patch_costs();
   }
 
-  void regenerate_planned_groceries()
-  {
-    db_clear_planned_groceries();
-    db_generate_planned_groceries();
-    groceries->select();
-    query_refresh(estimates);
+  void database_changed(const DbChanges &changes)
+  {
+    unit_names->apply(changes);
+    apply_costs(changes);
+    food_names->apply(changes);
+    recipe_names->apply(changes);
+
+    if (changes.contains("foods"))
+      update_food_groceries(changes.value("foods"));
+
+    if (planned)
+      planned->apply(changes);
+    if (recipes)
+      recipes->apply(changes);
+    if (recipe_search)
+      recipe_search->apply(changes);
+    if (suggestions)
+      suggestions->apply(changes);
+    if (estimates)
+      estimates->apply(changes);
+    if (groceries)
+      groceries->apply(changes);
+    if (foods)
+      foods->apply(changes);
+    if (ingredients)
+      ingredients->apply(changes);
   }
 
   bool add_planned(QString name)
   {
-    int recipe_id = db_recipe_id(name);
+    int recipe_id = recipe_names->id(name);
     if (recipe_id < 0)
       return false;
-    if (db_add_planned(recipe_id))
+    plan_recipe(recipe_id);
+    return true;
+  }
+
+  void plan_recipe(int recipe_id)
+  {
+    db_post(QString(), [recipe_id]()
     {
-      query_refresh(planned);
-      regenerate_planned_groceries();
-      return true;
-    }
-    return false;
+      if (db_add_planned(recipe_id))
+        db_update_planned_groceries(db_recipe_foods(recipe_id));
+    });
+  }
+
+  void remove_selected_planned()
+  {
+    auto select = app->ui->plannedView->selectionModel();
+    if (!select->hasSelection())
+      return;
+    QList<int> ids;
+    for (auto index : select->selectedRows(0))
+      ids.append(index.data().toInt());
+    db_post(QString(), [ids]()
+    {
+      QList<int> affected;
+      for (int id : ids)
+      {
+        if (db_remove_planned(id))
+          affected.append(db_recipe_foods(id));
+      }
+      if (!affected.isEmpty())
+        db_update_planned_groceries(affected);
+    });
+  }
+
+  // Replaces the plan with the best one for a budget and meal count
+  void optimize_planned()
+  {
+    bool ok;
+    double budget = QInputDialog::getDouble(app, "Optimize Plan", "Budget:", 100, 0, 1e9, 2, &ok);
+    if (!ok)
+      return;
+    double meals = QInputDialog::getDouble(app, "Optimize Plan", "Meals:", 14, 1, 1e6, 1, &ok);
+    if (!ok)
+      return;
+    PlanRequest request;
+    request.budget = budget;
+    request.meals = meals;
+    // the search runs on a read thread, so queued edits are not held up
+    // behind it; only writing the plan waits on the worker
+    db_read<PlanResult>([request]()
+    {
+      return plan_optimize(request);
+    },
+    app,
+    [this](PlanResult result)
+    {
+      db_post<bool>("optimize", [result]()
+      {
+        return plan_apply(result);
+      },
+      app,
+      [this, result](bool applied)
+      {
+        if (!applied)
+        {
+          QMessageBox::warning(app, "Optimize Plan", "Could not save the plan.");
+          return;
+        }
+        QString text = QString("Planned %1 recipes for %2 meals at %3.")
+          .arg(result.recipes.size()).arg(result.meals).arg(QLocale().toCurrencyString(result.cost));
+        if (!result.exhaustive)
+          text += " The search stopped early, so a better plan may exist.";
+        QMessageBox::information(app, "Optimize Plan", text);
+      });
+    });
+  }
+
+  // Costs recipes and the plan under the scenarios in a CSV file on a read
+  // thread, with an engine of its own, leaving stored prices alone
+  void price_scenarios()
+  {
+    QString path = QFileDialog::getOpenFileName(app, "Price Scenarios", QString(), "CSV (*.csv)");
+    if (path.isEmpty())
+      return;
+    db_read<ScenarioReport>([path]()
+    {
+      ScenarioReport report;
+      QList<PriceScenario> scenarios;
+      report.read = read_scenarios(path, scenarios);
+      CostEngine costs;
+      if (report.read && costs.load())
+        report.results = evaluate_scenarios(costs, scenarios, db_planned_recipes(), 20);
+      return report;
+    },
+    app,
+    [this, path](ScenarioReport report)
+    {
+      if (report.read)
+        show_scenarios(report.results);
+      else
+        QMessageBox::warning(app, "Price Scenarios", "Could not read scenarios from " + path + ".");
+    });
+  }
+
+  void show_scenarios(const QList<ScenarioResult> &results)
+  {
+    auto model = new ScenarioModel(recipe_names);
+    model->set_results(results);
+
+    auto dialog = new QDialog(app);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->setWindowTitle("Price Scenarios");
+    model->setParent(dialog);
+    auto view = new QTableView(dialog);
+    view->setModel(model);
+    for (int column = 2; column < 5; column++)
+      view->setItemDelegateForColumn(column, currency_delegate);
+    auto layout = new QVBoxLayout(dialog);
+    layout->addWidget(view);
+    dialog->resize(640, 480);
+    dialog->show();
   }
 
   void clear_planned()
   {
-    db_clear_planned_groceries();
-    groceries->select();
-    db_clear_planned();
-    query_refresh(planned);
-    query_refresh(estimates);
+    db_post("clear_planned", []()
+    {
+      db_clear_planned_groceries();
+      db_clear_planned();
+    });
   }
 };
 
@@ -346,58 +720,66 @@ App::App() : ui(new Ui::App), impl(std::make_unique<Impl>(this))
 {
   ui->setupUi(this);
 
-  ui->plannedView->setModel(impl->planned);
-  ui->plannedView->setSelectionMode(QAbstractItemView::NoSelection);
-  ui->plannedView->setItemDelegate(new NameToIdDelegate(db_recipe_id_map(), this));
+  ui->plannedView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+  ui->plannedView->setSelectionMode(QAbstractItemView::MultiSelection);
+  ui->plannedView->setSelectionBehavior(QAbstractItemView::SelectRows);
+  ui->plannedView->setItemDelegateForColumn(2, impl->currency_delegate);
+  ui->plannedView->setItemDelegateForColumn(3, impl->currency_delegate);
 
-  ui->groceriesView->setModel(impl->groceries);
   ui->groceriesView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
   ui->groceriesView->setSelectionMode(QAbstractItemView::MultiSelection);
   ui->groceriesView->setSelectionBehavior(QAbstractItemView::SelectRows);
-  ui->groceriesView->setItemDelegateForColumn(1, new NameToIdDelegate(db_food_id_map(), this));
+  ui->groceriesView->setItemDelegateForColumn(1, new NameToIdDelegate(impl->food_names, this));
 
-  ui->recipesView->setModel(impl->recipes);
   ui->recipesView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
   ui->recipesView->setSelectionMode(QAbstractItemView::MultiSelection);
   ui->recipesView->setSelectionBehavior(QAbstractItemView::SelectRows);
+  ui->recipesView->setItemDelegateForColumn(2, impl->currency_delegate);
   ui->recipesView->setItemDelegateForColumn(3, impl->currency_delegate);
-  ui->recipesView->setItemDelegateForColumn(4, impl->currency_delegate);
-  ui->recipesView->setItemDelegateForColumn(5, impl->currency_delegate);
 
-  ui->foodsView->setModel(impl->foods);
   ui->foodsView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
   ui->foodsView->setSelectionMode(QAbstractItemView::MultiSelection);
   ui->foodsView->setSelectionBehavior(QAbstractItemView::SelectRows);
   ui->foodsView->setItemDelegateForColumn(3, impl->currency_delegate);
+  ui->foodsView->setItemDelegateForColumn(4, new NameToIdDelegate(impl->unit_names, this));
 
-  ui->ingredientsView->setModel(impl->ingredients);
   ui->ingredientsView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
   ui->ingredientsView->setSelectionMode(QAbstractItemView::MultiSelection);
   ui->ingredientsView->setSelectionBehavior(QAbstractItemView::SelectRows);
-  ui->ingredientsView->setItemDelegateForColumn(2, new NameToIdDelegate(db_food_id_map(), this));
-  ui->ingredientsView->setItemDelegateForColumn(3, new NameToIdDelegate(db_unit_id_map(), this));
+  ui->ingredientsView->setItemDelegateForColumn(2, new NameToIdDelegate(impl->food_names, this));
+  ui->ingredientsView->setItemDelegateForColumn(3, new NameToIdDelegate(impl->unit_names, this));
 
-  ui->estimatesView->setModel(impl->estimates);
   ui->estimatesView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
   ui->estimatesView->setSelectionMode(QAbstractItemView::NoSelection);
   ui->estimatesView->setItemDelegateForColumn(0, impl->currency_delegate);
   ui->estimatesView->setItemDelegateForColumn(1, impl->currency_delegate);
   ui->estimatesView->setItemDelegateForColumn(2, impl->currency_delegate);
 
-#ifdef QT_NO_DEBUG
-  ui->recipesView->hideColumn(0);
-  ui->groceriesView->hideColumn(0);
-  ui->groceriesView->hideColumn(3);
-  ui->foodsView->hideColumn(0);
-  ui->ingredientsView->hideColumn(0);
-  ui->ingredientsView->hideColumn(1);
-#endif
+  ui->statsView->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+  ui->statsView->setSelectionMode(QAbstractItemView::NoSelection);
+
+  // statement stats are only collected with --trace
+  if (!db_trace_enabled())
+    ui->tabs->removeTab(stats_tab_idx);
 
   ui->tabs->setCurrentIndex(groceries_tab_idx);
   ui->recipeTab->setEnabled(false);
+  impl->show_tab(groceries_tab_idx);
 
-  impl->reset_food_completer();
-  impl->reset_recipe_completer();
+  ui->lePlanned->setCompleter(impl->recipe_names->completer(this));
+  QCompleter *food_completer = impl->food_names->completer(this);
+  ui->leIngredient->setCompleter(food_completer);
+  ui->leGrocery->setCompleter(food_completer);
+
+  connect(db_notifier(), &DbNotifier::changed, this, [this](const DbChanges &changes)
+  {
+    impl->database_changed(changes);
+  });
+
+  connect(ui->tabs, &QTabWidget::currentChanged, this, [this](int index)
+  {
+    impl->show_tab(index);
+  });
 
   connect(ui->bAddRecipe, &QPushButton::released, this, [this]()
   {
@@ -405,12 +787,22 @@ App::App() : ui(new Ui::App), impl(std::make_unique<Impl>(this))
       impl->start_add_recipe("Untitled");
   });
 
+  connect(ui->leRecipeSearch, &QLineEdit::textChanged, this, [this](const QString &text)
+  {
+    impl->search_recipes(text);
+  });
+
   connect(ui->bDeleteRecipe, &QPushButton::released, this, [this]()
   {
     if (confirmed(this, "Delete Selected Recipes"))
       impl->remove_selected_recipes();
   });
 
+  connect(ui->bScenarios, &QPushButton::released, this, [this]()
+  {
+    impl->price_scenarios();
+  });
+
   connect(ui->bDoneRecipe, &QPushButton::released, this, [this]()
   {
     impl->stop_edit_recipe();
@@ -418,8 +810,7 @@ App::App() : ui(new Ui::App), impl(std::make_unique<Impl>(this))
 
   connect(ui->leFood, &QLineEdit::returnPressed, this, [this]()
   {
-    if (impl->add_food(ui->leFood->text()))
-      ui->leFood->clear();
+    impl->add_food(ui->leFood->text());
   });
 
   connect(ui->bDeleteFood, &QPushButton::released, this, [this]()
@@ -436,8 +827,7 @@ App::App() : ui(new Ui::App), impl(std::make_unique<Impl>(this))
 
   connect(ui->leIngredient, &QLineEdit::returnPressed, this, [this]()
   {
-    if (impl->add_ingredient(impl->recipe_id, ui->leIngredient->text()))
-      ui->leIngredient->clear();
+    impl->add_ingredient(impl->recipe_id, ui->leIngredient->text());
   });
 
   connect(ui->bDeleteIngredient, &QPushButton::released, this, [this]()
@@ -448,8 +838,7 @@ App::App() : ui(new Ui::App), impl(std::make_unique<Impl>(this))
 
   connect(ui->leGrocery, &QLineEdit::returnPressed, this, [this]()
   {
-    if (impl->add_grocery(ui->leGrocery->text()))
-      ui->leGrocery->clear();
+    impl->add_grocery(ui->leGrocery->text());
   });
 
   connect(ui->lePlanned, &QLineEdit::returnPressed, this, [this]()
@@ -469,22 +858,50 @@ App::App() : ui(new Ui::App), impl(std::make_unique<Impl>(this))
     impl->regenerate_planned_groceries();
   });
 
+  connect(ui->bOptimizePlanned, &QPushButton::released, this, [this]()
+  {
+    if (confirmed(this, "Replace Plan"))
+      impl->optimize_planned();
+  });
+
+  connect(ui->suggestionsView, &QTableView::doubleClicked, this, [this](const QModelIndex &index)
+  {
+    impl->plan_recipe(index.siblingAtColumn(0).data().toInt());
+  });
+
+  connect(ui->bRemovePlanned, &QPushButton::released, this, [this]()
+  {
+    if (confirmed(this, "Un-Plan Selected"))
+      impl->remove_selected_planned();
+  });
+
+  connect(ui->bRefreshStats, &QPushButton::released, this, [this]()
+  {
+    impl->refresh_stats();
+  });
+
+  connect(ui->bResetStats, &QPushButton::released, this, [this]()
+  {
+    db_trace_reset();
+    impl->refresh_stats();
+  });
+
+  connect(ui->bExportStats, &QPushButton::released, this, [this]()
+  {
+    impl->export_stats();
+  });
+
   connect(ui->bDeleteGrocery, &QPushButton::released, this, [this]()
   {
     if (confirmed(this, "Remove Selected Groceries"))
       impl->remove_selected_groceries();
   });
 
-  connect(ui->plannedView, &QListView::doubleClicked, this, [this](const QModelIndex &index)
+  connect(ui->plannedView, &QTableView::doubleClicked, this, [this](const QModelIndex &index)
   {
     if (impl->recipe_id < 0 || confirmed(this, "Edit Recipe (Abandon Current Edit)"))
       impl->start_edit_recipe(index.siblingAtColumn(0).data().toInt());
   });
-
-  connect(ui->bRefreshRecipes, &QPushButton::released, this, [this]()
-  {
-    query_refresh(impl->recipes);
-  });
 }
 
 App::~App()
@@ -1,35 +1,22 @@
 
 #include "appinit.h"
 #include "database.h"
+#include "dbnotifier.h"
 
-namespace
+AppInit::AppInit(int &argc, char **argv, const Options &options_) :
+  QApplication(argc, argv),
+  options(options_)
 {
-  void check_fatal(bool cond, const char *msg)
-  {
-    if(!cond)
-    {
-      qCritical("%s\n", msg);
-      exit(-1);
-    }
-  }
-}
-
-AppInit::AppInit(int &argc, char **argv) : QApplication(argc, argv)
-{
-  QString dbsrc;
-  for (int i = 1; i < argc; i++)
-  {
-    QString arg(argv[i]);
-    if (arg == "--db")
-    {
-      check_fatal(argc > i + 1, "Missing argument for --db option");
-      dbsrc = argv[i + 1];
-    }
-  }
-  check_fatal(db_init(dbsrc), "Unable to connect to or initialize database");
+  init_database(options);
+  // models are built after this, so nothing needs to hear about imports
+  if (!options.imports.isEmpty())
+    db_notifier()->discard();
+  // the GUI only reads; edits are written on the worker's connection
+  if (!db_start_worker())
+    qWarning("Unable to start the database worker, writing on the GUI thread");
 }
 
 AppInit::~AppInit()
 {
+  finish_database(options);
 }
-
@@ -2,14 +2,19 @@
 #ifndef appinit_h
 #define appinit_h
 
+#include "options.h"
+
 #include <QApplication>
 #include <memory>
 
 class AppInit : public QApplication
 {
   public:
-    AppInit(int &argc, char **argv);
+    AppInit(int &argc, char **argv, const Options&);
     ~AppInit();
+
+  private:
+    Options options;
 };
 
 #endif
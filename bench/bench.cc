@@ -0,0 +1,340 @@
+
+#include "catalog.h"
+#include "costengine.h"
+#include "database.h"
+#include "dbnotifier.h"
+#include "models.h"
+#include "nameindex.h"
+#include "options.h"
+#include "units.h"
+
+#include <QApplication>
+#include <QCompleter>
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace
+{
+  struct BenchOptions
+  {
+    QList<qint64> scales = {100, 1000, 10000, 100000, 1000000};
+    int runs = 20;
+    int min_ingredients = 5;
+    int max_ingredients = 15;
+    int planned = 25;
+    quint64 seed = 1;
+    int readers = 4;
+    bool csv = false;
+  };
+
+  BenchOptions parse_bench_options(int argc, char **argv)
+  {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+      QString arg(argv[i]);
+      QString value = i + 1 < argc ? argv[i + 1] : "";
+      if (arg == "--csv")
+      {
+        options.csv = true;
+        continue;
+      }
+      check_fatal(i + 1 < argc, "Missing option argument");
+      i++;
+      if (arg == "--scales")
+      {
+        options.scales.clear();
+        for (auto scale : value.split(','))
+          options.scales.append(scale.toLongLong());
+      }
+      else if (arg == "--runs")
+        options.runs = value.toInt();
+      else if (arg == "--ingredients")
+      {
+        // MIN:MAX per recipe
+        options.min_ingredients = value.section(':', 0, 0).toInt();
+        options.max_ingredients = value.section(':', 1, 1).toInt();
+      }
+      else if (arg == "--planned")
+        options.planned = value.toInt();
+      else if (arg == "--seed")
+        options.seed = value.toULongLong();
+      else if (arg == "--readers")
+        options.readers = value.toInt();
+      else
+        check_fatal(false, "Unknown option");
+    }
+    check_fatal(options.runs > 0, "--runs must be positive");
+    check_fatal(options.readers > 0, "--readers must be positive");
+    check_fatal(
+        options.min_ingredients > 0 && options.max_ingredients >= options.min_ingredients,
+        "--ingredients must be MIN:MAX with 0 < MIN <= MAX"
+        );
+    return options;
+  }
+
+  class Report
+  {
+    public:
+      Report(bool csv_) : out(stdout), csv(csv_)
+      {
+        if (csv)
+          out << "ingredients,operation,runs,p50_ms,p90_ms,p99_ms,max_ms,ops_per_s\n";
+      }
+
+      void scale(qint64 ingredients, const CatalogSpec &spec, qint64 msecs)
+      {
+        this->ingredients = ingredients;
+        if (!csv)
+        {
+          out << QString("\n%1 ingredients, %2 recipes, %3 foods (generated in %4 s)\n")
+            .arg(ingredients).arg(spec.recipes).arg(spec.foods).arg(msecs / 1000.0, 0, 'f', 2);
+          out << QString("%1 %2 %3 %4 %5 %6\n")
+            .arg("operation", -28).arg("p50 ms", 10).arg("p90 ms", 10).arg("p99 ms", 10).arg("max ms", 10).arg("ops/s", 12);
+        }
+        out.flush();
+      }
+
+      // Runs op once to warm caches, then times runs calls of it
+      void measure(QString name, int runs, std::function<void()> op)
+      {
+        op();
+        std::vector<qint64> nsecs;
+        QElapsedTimer timer;
+        for (int i = 0; i < runs; i++)
+        {
+          timer.start();
+          op();
+          nsecs.push_back(timer.nsecsElapsed());
+        }
+        std::sort(nsecs.begin(), nsecs.end());
+        qint64 total = 0;
+        for (auto n : nsecs)
+          total += n;
+        double per_second = total > 0 ? runs * 1e9 / total : 0;
+        QString p50 = msecs(nsecs, 0.50), p90 = msecs(nsecs, 0.90), p99 = msecs(nsecs, 0.99), max = msecs(nsecs, 1.0);
+        if (csv)
+          out << QString("%1,%2,%3,%4,%5,%6,%7,%8\n")
+            .arg(ingredients).arg(name).arg(runs).arg(p50).arg(p90).arg(p99).arg(max).arg(per_second, 0, 'f', 1);
+        else
+          out << QString("%1 %2 %3 %4 %5 %6\n")
+            .arg(name, -28).arg(p50, 10).arg(p90, 10).arg(p99, 10).arg(max, 10).arg(per_second, 12, 'f', 1);
+        out.flush();
+      }
+
+      void note(QString text)
+      {
+        if (!csv)
+          out << text << "\n";
+        out.flush();
+      }
+
+    private:
+      QTextStream out;
+      bool csv;
+      qint64 ingredients = 0;
+
+      static QString msecs(const std::vector<qint64> &sorted, double percentile)
+      {
+        size_t i = std::min(sorted.size() - 1, size_t(percentile * sorted.size()));
+        return QString::number(sorted[i] / 1e6, 'f', 3);
+      }
+  };
+
+  // The per-recipe cost aggregate that recipe_costs materializes, with
+  // fresh quantities converted to each food's purchase unit
+  void aggregate_recipe_costs()
+  {
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.exec(
+        "select i.recipe,"
+        " sum(case f.staple when 1 then f.price else 0 end),"
+        " sum(case f.staple when 0 then " + unit_quantity_sql("i.quantity", "i.unit", "f.unit") + " * f.price else 0 end) "
+        "from ingredients i join foods f on f.id = i.food group by i.recipe;"
+        );
+    while (query.next())
+      ;
+  }
+
+  class ReadTask : public QRunnable
+  {
+    public:
+      ReadTask(std::function<void()> read_) : read(read_)
+      {
+      }
+
+      void run() override
+      {
+        DbReader reader;
+        if (reader.ok())
+          read();
+      }
+
+    private:
+      std::function<void()> read;
+  };
+
+  // Runs read once on each pool thread at the same time, each thread through its own reader
+  void read_in_parallel(QThreadPool &pool, std::function<void()> read)
+  {
+    for (int i = 0; i < pool.maxThreadCount(); i++)
+      pool.start(new ReadTask(read));
+    pool.waitForDone();
+  }
+
+  void bench_scale(const BenchOptions &options, qint64 scale, Report &report)
+  {
+    CatalogSpec spec;
+    int average = (options.min_ingredients + options.max_ingredients) / 2;
+    spec.recipes = int(std::max<qint64>(1, scale / average));
+    spec.foods = int(std::max<qint64>(20, scale / 20));
+    spec.min_ingredients = options.min_ingredients;
+    spec.max_ingredients = options.max_ingredients;
+    spec.staples = 0.2;
+    spec.seed = options.seed;
+
+    check_fatal(db_init(""), "Unable to initialize database");
+    QElapsedTimer timer;
+    timer.start();
+    qint64 ingredients = generate_catalog(spec);
+    check_fatal(ingredients >= 0, "Unable to generate catalog");
+    for (int id = 1; id <= std::min(options.planned, spec.recipes); id++)
+      db_add_planned(id);
+    report.scale(ingredients, spec, timer.elapsed());
+
+    report.measure("generate planned groceries", options.runs, []()
+    {
+      db_clear_planned_groceries();
+      db_generate_planned_groceries();
+    });
+    report.measure("rebuild grocery totals", options.runs, []()
+    {
+      db_rebuild_grocery_totals();
+    });
+    report.measure("estimates", options.runs, []()
+    {
+      db_grocery_totals();
+    });
+    report.measure("recipe cost aggregate", options.runs, []()
+    {
+      aggregate_recipe_costs();
+    });
+
+    CostEngine costs;
+    report.measure("cost engine load", options.runs, [&]()
+    {
+      costs.load();
+    });
+
+    // prices scaled 0.5x to 1.5x across scenarios, food-major as the kernels read them
+    const int scenarios = 64;
+    std::vector<double> prices(size_t(costs.food_count()) * scenarios);
+    for (int column = 0; column < costs.food_count(); column++)
+    {
+      for (int s = 0; s < scenarios; s++)
+        prices[size_t(column) * scenarios + s] = costs.prices()[column] * (0.5 + double(s) / scenarios);
+    }
+    std::vector<double> staples(size_t(costs.recipe_count()) * scenarios);
+    std::vector<double> fresh(size_t(costs.recipe_count()) * scenarios);
+    report.measure(QString("recipe costs x%1 scenarios").arg(scenarios), options.runs, [&]()
+    {
+      costs.recipe_costs(prices.data(), scenarios, staples.data(), fresh.data());
+    });
+    QList<int> plan;
+    for (int id = 1; id <= std::min(options.planned, spec.recipes); id++)
+      plan.append(costs.recipe_row(id));
+    report.measure(QString("plan costs x%1 scenarios").arg(scenarios), options.runs, [&]()
+    {
+      costs.plan_costs(plan, prices.data(), scenarios, staples.data(), fresh.data());
+    });
+    report.measure("staple overlap suggestions", options.runs, [&]()
+    {
+      costs.suggest(plan, QList<int>(), 50);
+    });
+
+    RecipesModel recipes;
+    report.measure("recipes first page", options.runs, [&]()
+    {
+      recipes.reload();
+    });
+
+    NameIndex foods("foods");
+    report.measure("food name index load", options.runs, [&]()
+    {
+      foods.reload();
+    });
+
+    int next = 0;
+    report.measure("food name index update", options.runs, [&]()
+    {
+      int id = db_add_food(QString("bench food %1").arg(next++));
+      DbChanges changes;
+      changes["foods"].inserted.insert(id);
+      foods.apply(changes);
+      db_remove_id("foods", id);
+      changes["foods"] = DbTableChanges();
+      changes["foods"].deleted.insert(id);
+      foods.apply(changes);
+    });
+
+    QCompleter *completer = foods.completer();
+    quint64 prefix = options.seed;
+    report.measure("food completion lookup", options.runs, [&]()
+    {
+      prefix = prefix * 6364136223846793005ULL + 1442695040888963407ULL;
+      completer->setCompletionPrefix(QString("food %1").arg(int((prefix >> 33) % spec.foods), 6, 10, QChar('0')).left(8));
+      completer->currentCompletion();
+    });
+    delete completer;
+
+    quint64 term = options.seed;
+    report.measure(db_search_available() ? "recipe search" : "recipe search (like)", options.runs, [&]()
+    {
+      term = term * 6364136223846793005ULL + 1442695040888963407ULL;
+      db_search_recipes(QString("food %1").arg(int((term >> 33) % spec.foods), 6, 10, QChar('0')).left(9));
+    });
+
+    // threads are kept so each keeps its reader connection between runs
+    QThreadPool pool;
+    pool.setMaxThreadCount(options.readers);
+    pool.setExpiryTimeout(-1);
+    db_set_reader_pool_size(options.readers);
+    report.measure(QString("grocery list x%1 readers").arg(options.readers), options.runs, [&]()
+    {
+      read_in_parallel(pool, []() { db_grocery_list(); });
+    });
+    report.measure(QString("food names x%1 readers").arg(options.readers), options.runs, [&]()
+    {
+      read_in_parallel(pool, []() { db_food_names(); });
+    });
+    DbReaderPoolStats stats = db_reader_pool_stats();
+    report.note(QString("reader pool: %1 open, peak %2 of %3, %4 checkouts, %5 waits (%6 ms)")
+        .arg(stats.open).arg(stats.peak).arg(stats.size).arg(stats.checkouts).arg(stats.waits)
+        .arg(stats.wait_ns / 1e6, 0, 'f', 3));
+
+    // discard what the notifier queued while generating
+    db_notifier()->discard();
+    db_close();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  QApplication app(argc, argv);
+  BenchOptions options = parse_bench_options(argc, argv);
+  Report report(options.csv);
+  for (auto scale : options.scales)
+    bench_scale(options, scale, report);
+  return 0;
+}
@@ -0,0 +1,42 @@
+TARGET = bench
+
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+QT += core widgets sql
+
+# Change notifications and tracing call this library on the QSQLITE
+# driver's connections, so Qt must be configured with -system-sqlite
+LIBS += -lsqlite3
+
+INCLUDEPATH += ..
+
+SOURCES = \
+  bench.cc \
+  catalog.cc \
+  ../database.cc \
+  ../units.cc \
+  ../dbnotifier.cc \
+  ../dbworker.cc \
+  ../dbtrace.cc \
+  ../sqlitehandle.cc \
+  ../models.cc \
+  ../costengine.cc \
+  ../nameindex.cc \
+  ../options.cc \
+  ../importer.cc
+
+HEADERS = \
+  catalog.h \
+  ../database.h \
+  ../units.h \
+  ../dbnotifier.h \
+  ../dbworker.h \
+  ../dbtrace.h \
+  ../sqlitehandle.h \
+  ../rowmodel.h \
+  ../models.h \
+  ../costengine.h \
+  ../nameindex.h \
+  ../options.h \
+  ../importer.h
@@ -0,0 +1,90 @@
+
+#include "catalog.h"
+#include "database.h"
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariant>
+
+namespace
+{
+  // splitmix64, so generated catalogs match across platforms and standard libraries
+  class Random
+  {
+    public:
+      Random(quint64 seed) : state(seed)
+      {
+      }
+
+      quint64 next()
+      {
+        quint64 z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+      }
+
+      // uniform over [low, high]
+      int between(int low, int high)
+      {
+        return low + int(next() % quint64(high - low + 1));
+      }
+
+      double unit()
+      {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+      }
+
+    private:
+      quint64 state;
+  };
+}
+
+qint64 generate_catalog(const CatalogSpec &spec)
+{
+  Random random(spec.seed);
+  QSqlDatabase db = QSqlDatabase::database();
+  if (!db.transaction())
+    return -1;
+
+  QList<int> foods;
+  for (int i = 0; i < spec.foods; i++)
+  {
+    QVariant staple = random.unit() < spec.staples ? 1 : 0;
+    QVariant price = random.between(25, 2000) / 100.0;
+    int id = db_upsert_food(QString("food %1").arg(i, 6, 10, QChar('0')), staple, price);
+    if (id < 0)
+    {
+      db.rollback();
+      return -1;
+    }
+    foods.append(id);
+  }
+
+  qint64 ingredients = 0;
+  for (int i = 0; i < spec.recipes; i++)
+  {
+    int recipe = db_add_recipe(QString("recipe %1").arg(i, 6, 10, QChar('0')));
+    if (recipe < 0)
+    {
+      db.rollback();
+      return -1;
+    }
+    int count = random.between(spec.min_ingredients, spec.max_ingredients);
+    for (int j = 0; j < count && !foods.isEmpty(); j++)
+    {
+      int food = foods[random.between(0, foods.size() - 1)];
+      QVariant quantity = random.between(1, 16) / 4.0;
+      if (db_add_ingredient(recipe, food, QVariant(), quantity) < 0)
+      {
+        db.rollback();
+        return -1;
+      }
+      ingredients++;
+    }
+  }
+
+  if (!db.commit())
+    return -1;
+  return ingredients;
+}
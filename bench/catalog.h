@@ -0,0 +1,24 @@
+
+#ifndef catalog_h
+#define catalog_h
+
+#include <QtGlobal>
+
+struct CatalogSpec
+{
+  int foods;
+  int recipes;
+  // ingredients per recipe are drawn uniformly from [min, max]
+  int min_ingredients;
+  int max_ingredients;
+  // fraction of foods that are staples
+  double staples;
+  quint64 seed;
+};
+
+// Fills the open database with generated foods, recipes and ingredients.
+// The same spec always produces the same rows. Returns the number of
+// ingredients added, or -1 on failure.
+qint64 generate_catalog(const CatalogSpec&);
+
+#endif
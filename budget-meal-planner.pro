@@ -5,18 +5,49 @@ CONFIG += c++14
 
 QT += core widgets sql
 
+# Change notifications and tracing call this library on the QSQLITE
+# driver's connections, so Qt must be configured with -system-sqlite
+LIBS += -lsqlite3
+
 SOURCES = \
   main.cc \
+  options.cc \
+  cli.cc \
   database.cc \
+  units.cc \
+  dbnotifier.cc \
+  dbworker.cc \
+  dbtrace.cc \
+  sqlitehandle.cc \
   appinit.cc \
+  importer.cc \
   app.cc \
+  models.cc \
+  costengine.cc \
+  scenario.cc \
+  nameindex.cc \
+  optimizer.cc \
   nametoiddelegate.cc \
   currencydelegate.cc
 
 HEADERS = \
   database.h \
+  units.h \
+  options.h \
+  cli.h \
+  dbnotifier.h \
+  dbworker.h \
+  dbtrace.h \
+  sqlitehandle.h \
   appinit.h \
+  importer.h \
   app.h \
+  rowmodel.h \
+  models.h \
+  costengine.h \
+  scenario.h \
+  nameindex.h \
+  optimizer.h \
   nametoiddelegate.h \
   currencydelegate.h
 
@@ -0,0 +1,262 @@
+
+#include "cli.h"
+#include "costengine.h"
+#include "database.h"
+#include "optimizer.h"
+#include "options.h"
+#include "scenario.h"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <cstdio>
+
+namespace
+{
+  QString csv_field(QString value)
+  {
+    if (!value.contains(',') && !value.contains('"') && !value.contains('\n'))
+      return value;
+    return "\"" + value.replace("\"", "\"\"") + "\"";
+  }
+
+  QString number(double value)
+  {
+    return QString::number(value, 'f', 2);
+  }
+
+  QString json_line(const QJsonObject &object)
+  {
+    return QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+  }
+
+  QString change(double before, double after)
+  {
+    return (after >= before ? "+" : "") + number(after - before);
+  }
+
+  // Plans each recipe, given by id or name; returns false if any is unknown
+  bool plan_recipes(QStringList recipes)
+  {
+    bool ok = true;
+    for (auto recipe : recipes)
+    {
+      bool numeric;
+      int id = recipe.toInt(&numeric);
+      if (!numeric || db_recipe_name(id).isNull())
+        id = db_recipe_id(recipe);
+      if (id < 0)
+      {
+        qWarning("Unknown recipe: %s", qPrintable(recipe));
+        ok = false;
+        continue;
+      }
+      db_add_planned(id);
+    }
+    return ok;
+  }
+
+  void write_text(QTextStream &out)
+  {
+    for (auto grocery : db_grocery_list())
+      out << QString("%1 %2 %3\n").arg(grocery.food, -32).arg(number(grocery.quantity), 10).arg(number(grocery.cost), 10);
+    DbGroceryTotals totals = db_grocery_totals();
+    out << "\n";
+    out << QString("%1 %2\n").arg("Staples", -43).arg(number(totals.staples), 10);
+    out << QString("%1 %2\n").arg("Fresh", -43).arg(number(totals.fresh), 10);
+    out << QString("%1 %2\n").arg("Total", -43).arg(number(totals.staples + totals.fresh), 10);
+  }
+
+  void write_csv(QTextStream &out)
+  {
+    out << "kind,food,quantity,cost\n";
+    for (auto grocery : db_grocery_list())
+    {
+      out << (grocery.generated ? "generated," : "added,") << csv_field(grocery.food) << ","
+          << number(grocery.quantity) << "," << number(grocery.cost) << "\n";
+    }
+    DbGroceryTotals totals = db_grocery_totals();
+    out << "staples,,," << number(totals.staples) << "\n";
+    out << "fresh,,," << number(totals.fresh) << "\n";
+    out << "total,,," << number(totals.staples + totals.fresh) << "\n";
+  }
+
+  void write_json(QTextStream &out)
+  {
+    out << "{\"groceries\":[";
+    bool first = true;
+    for (auto grocery : db_grocery_list())
+    {
+      QJsonObject object;
+      object.insert("food", grocery.food);
+      object.insert("quantity", grocery.quantity);
+      object.insert("cost", grocery.cost);
+      object.insert("generated", grocery.generated);
+      out << (first ? "\n" : ",\n") << json_line(object);
+      first = false;
+    }
+    DbGroceryTotals totals = db_grocery_totals();
+    QJsonObject object;
+    object.insert("staples", totals.staples);
+    object.insert("fresh", totals.fresh);
+    object.insert("total", totals.staples + totals.fresh);
+    out << "\n],\"totals\":" << json_line(object) << "}\n";
+  }
+
+  void write_scenarios_text(QTextStream &out, const QList<ScenarioResult> &results)
+  {
+    for (auto result : results)
+    {
+      out << QString("%1 %2 %3 %4\n").arg(result.name, -32)
+        .arg(number(result.plan_base), 10).arg(number(result.plan_cost), 10).arg(change(result.plan_base, result.plan_cost), 10);
+      for (auto recipe : result.recipes)
+      {
+        out << QString("  %1 %2 %3 %4\n").arg(db_recipe_name(recipe.id), -30)
+          .arg(number(recipe.base), 10).arg(number(recipe.cost), 10).arg(change(recipe.base, recipe.cost), 10);
+      }
+      out << "\n";
+    }
+  }
+
+  void write_scenarios_csv(QTextStream &out, const QList<ScenarioResult> &results)
+  {
+    out << "scenario,kind,recipe,base,cost,change\n";
+    for (auto result : results)
+    {
+      QString scenario = csv_field(result.name);
+      out << scenario << ",plan,," << number(result.plan_base) << "," << number(result.plan_cost) << ","
+          << change(result.plan_base, result.plan_cost) << "\n";
+      for (auto recipe : result.recipes)
+      {
+        out << scenario << ",recipe," << csv_field(db_recipe_name(recipe.id)) << "," << number(recipe.base) << ","
+            << number(recipe.cost) << "," << change(recipe.base, recipe.cost) << "\n";
+      }
+    }
+  }
+
+  void write_scenarios_json(QTextStream &out, const QList<ScenarioResult> &results)
+  {
+    out << "{\"scenarios\":[";
+    bool first = true;
+    for (auto result : results)
+    {
+      QJsonObject plan;
+      plan.insert("base", result.plan_base);
+      plan.insert("cost", result.plan_cost);
+      QJsonArray recipes;
+      for (auto recipe : result.recipes)
+      {
+        QJsonObject object;
+        object.insert("id", recipe.id);
+        object.insert("recipe", db_recipe_name(recipe.id));
+        object.insert("base", recipe.base);
+        object.insert("cost", recipe.cost);
+        recipes.append(object);
+      }
+      QJsonObject object;
+      object.insert("name", result.name);
+      object.insert("plan", plan);
+      object.insert("recipes", recipes);
+      out << (first ? "\n" : ",\n") << json_line(object);
+      first = false;
+    }
+    out << "\n]}\n";
+  }
+
+  // Reports options.scenarios against the stored prices; false if the file
+  // can not be read
+  bool write_scenarios(QTextStream &out, const Options &options)
+  {
+    QList<PriceScenario> scenarios;
+    if (!read_scenarios(options.scenarios, scenarios))
+      return false;
+    CostEngine costs;
+    if (!costs.load())
+      return false;
+    QList<ScenarioResult> results = evaluate_scenarios(costs, scenarios, db_planned_recipes(), options.top);
+    if (options.format == "csv")
+      write_scenarios_csv(out, results);
+    else if (options.format == "json")
+      write_scenarios_json(out, results);
+    else
+      write_scenarios_text(out, results);
+    return true;
+  }
+}
+
+int cli_run(int &argc, char **argv, const Options &options)
+{
+  QCoreApplication app(argc, argv);
+  init_database(options);
+
+  if (options.clear_plan)
+    db_clear_planned();
+  bool ok = true;
+  if (options.budget < 0)
+    ok = plan_recipes(options.plan);
+  else
+  {
+    PlanRequest request;
+    request.budget = options.budget;
+    request.meals = options.meals;
+    PlanResult result = plan_optimize(request);
+    ok = plan_apply(result) && ok;
+    qInfo(
+        "Planned %d recipes for %.1f meals at %.2f, reusing staples %d times (%llu nodes%s)",
+        result.recipes.size(),
+        result.meals,
+        result.cost,
+        result.staple_reuse,
+        result.nodes,
+        result.exhaustive ? "" : ", stopped early"
+        );
+  }
+  ok = db_clear_planned_groceries() && ok;
+  ok = db_generate_planned_groceries() && ok;
+  ok = db_rebuild_grocery_totals() && ok;
+
+  QTextStream out(stdout);
+  {
+    DbReader reader;
+    if (!options.scenarios.isEmpty())
+      ok = write_scenarios(out, options) && ok;
+    else if (options.format == "csv")
+      write_csv(out);
+    else if (options.format == "json")
+      write_json(out);
+    else
+      write_text(out);
+  }
+  out.flush();
+
+  finish_database(options);
+  return ok ? 0 : 1;
+}
+
+int cli_maintain(int &argc, char **argv, const Options &options)
+{
+  QCoreApplication app(argc, argv);
+  init_database(options);
+
+  DbMaintenance report;
+  bool ok = db_maintain(report);
+
+  QTextStream out(stdout);
+  out << QString("%1 %2 -> %3 KiB\n").arg("size", -20)
+    .arg(report.bytes_before / 1024.0, 0, 'f', 1).arg(report.bytes_after / 1024.0, 0, 'f', 1);
+  out << QString("%1 %2 -> %3\n").arg("free pages", -20).arg(report.free_pages_before).arg(report.free_pages_after);
+  out << QString("%1 %2\n").arg("vacuum", -20).arg(report.vacuumed ? "full" : "incremental");
+  out << "\n" << QString("%1 %2 %3\n").arg("query", -20).arg("before ms", 10).arg("after ms", 10);
+  for (auto timing : report.timings)
+  {
+    out << QString("%1 %2 %3\n").arg(timing.name, -20)
+      .arg(timing.before_ms, 10, 'f', 3).arg(timing.after_ms, 10, 'f', 3);
+  }
+  out.flush();
+
+  finish_database(options);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+
+#ifndef cli_h
+#define cli_h
+
+struct Options;
+
+// Runs without widgets: updates the meal plan from options, regenerates the
+// grocery list and writes it with its totals to stdout in options.format
+int cli_run(int &argc, char **argv, const Options&);
+// Runs db_maintain on options.db and prints what changed
+int cli_maintain(int &argc, char **argv, const Options&);
+
+#endif
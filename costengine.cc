@@ -0,0 +1,784 @@
+
+#include "costengine.h"
+#include "database.h"
+#include "units.h"
+
+#include <QHash>
+#include <QReadLocker>
+#include <QReadWriteLock>
+#include <QWriteLocker>
+#include <QtAlgorithms>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <algorithm>
+
+namespace
+{
+  // ids per "in (...)" list
+  const int id_chunk = 500;
+
+  struct Entry
+  {
+    int ingredient;
+    int column;
+    double quantity;
+  };
+
+  // Runs statement once per chunk of ids, with %1 replaced by the chunk
+  template <typename Read>
+  bool query_ids(QString statement, QList<int> ids, Read read)
+  {
+    std::sort(ids.begin(), ids.end());
+    QSqlQuery query(db_connection());
+    query.setForwardOnly(true);
+    for (int first = 0; first < ids.size(); first += id_chunk)
+    {
+      QStringList chunk;
+      for (int id : ids.mid(first, id_chunk))
+        chunk.append(QString::number(id));
+      if (!query.exec(statement.arg(chunk.join(','))))
+        return false;
+      while (query.next())
+        read(query);
+    }
+    return true;
+  }
+
+  QList<int> id_list(const QSet<qint64> &ids)
+  {
+    QList<int> result;
+    for (qint64 id : ids)
+      result.append(int(id));
+    return result;
+  }
+
+  // Makes values[first, last) count long, moving what follows
+  template <typename T>
+  void resize_span(std::vector<T> &values, int first, int last, int count)
+  {
+    if (count > last - first)
+      values.insert(values.begin() + last, count - (last - first), T());
+    else if (count < last - first)
+      values.erase(values.begin() + first + count, values.begin() + last);
+  }
+
+  // Moves the ends of row and every later row by delta
+  void shift_offsets(std::vector<int> &offsets, int row, int delta)
+  {
+    if (delta == 0)
+      return;
+    for (size_t i = row + 1; i < offsets.size(); i++)
+      offsets[i] += delta;
+  }
+}
+
+struct CostPatch
+{
+  struct Food
+  {
+    int id;
+    bool staple;
+    double price;
+    int unit;
+  };
+
+  struct Ingredient
+  {
+    int id;
+    int food;
+    double quantity;
+    int unit;
+  };
+
+  std::vector<Food> foods;
+  // planned state of recipes the changes named, false for removed ones
+  QHash<int, bool> planned;
+  // ids of the rows to replace, ascending
+  std::vector<int> recipes;
+  // ingredients of those still present, in id order; absent ones are removed
+  QHash<int, std::vector<Ingredient>> entries;
+};
+
+struct CostEngine::Impl
+{
+  // written by load and patch, read by read and suggest_ids from other
+  // threads
+  QReadWriteLock lock{QReadWriteLock::Recursive};
+  // rows
+  std::vector<int> recipe_ids;
+  QHash<int, int> rows;
+  std::vector<int> offsets;
+  // entries
+  std::vector<int> ingredient_ids;
+  std::vector<int> columns;
+  std::vector<double> quantities;
+  // columns
+  std::vector<int> food_ids;
+  QHash<int, int> food_columns;
+  std::vector<double> prices;
+  // purchase unit ids, 0 for none
+  std::vector<int> units;
+  std::vector<quint64> staple_bits;
+  // planned recipes using each column
+  std::vector<int> uses;
+  QSet<int> planned;
+  // per row at prices
+  std::vector<double> staples;
+  std::vector<double> fresh;
+  // per row, the nonzero 64-column words of its staple bitset
+  std::vector<int> word_offsets;
+  std::vector<int> word_indexes;
+  std::vector<quint64> word_bits;
+
+  bool staple(int column) const
+  {
+    return (staple_bits[column >> 6] >> (column & 63)) & 1;
+  }
+
+  void set_food(int id, bool staple, double price, int unit)
+  {
+    int column;
+    auto found = food_columns.constFind(id);
+    if (found != food_columns.constEnd())
+      column = found.value();
+    else
+    {
+      column = food_ids.size();
+      food_columns.insert(id, column);
+      food_ids.push_back(id);
+      prices.push_back(0);
+      units.push_back(unit);
+      if (staple_bits.size() * 64 <= size_t(column))
+        staple_bits.push_back(0);
+    }
+    prices[column] = price;
+    quint64 bit = quint64(1) << (column & 63);
+    if (staple)
+      staple_bits[column >> 6] |= bit;
+    else
+      staple_bits[column >> 6] &= ~bit;
+    units[column] = unit;
+  }
+
+  void read_food(const QSqlQuery &query)
+  {
+    set_food(query.value(0).toInt(), query.value(1).toInt() == 1, query.value(2).toDouble(), query.value(3).toInt());
+  }
+
+  void clear()
+  {
+    recipe_ids.clear();
+    rows.clear();
+    offsets.assign(1, 0);
+    ingredient_ids.clear();
+    columns.clear();
+    quantities.clear();
+    food_ids.clear();
+    food_columns.clear();
+    prices.clear();
+    units.clear();
+    staple_bits.clear();
+    uses.clear();
+    planned.clear();
+  }
+
+  void append(const Entry &entry)
+  {
+    ingredient_ids.push_back(entry.ingredient);
+    columns.push_back(entry.column);
+    quantities.push_back(entry.quantity);
+  }
+
+  bool make_entry(const CostPatch::Ingredient &ingredient, Entry &entry) const
+  {
+    auto found = food_columns.constFind(ingredient.food);
+    if (found == food_columns.constEnd())
+      return false;
+    // quantities are held in the food's purchase unit, as prices are
+    double quantity = ingredient.quantity * unit_factor(ingredient.unit, units[found.value()]);
+    entry = Entry{ingredient.id, found.value(), quantity};
+    return true;
+  }
+
+  static CostPatch::Ingredient read_ingredient(const QSqlQuery &query)
+  {
+    return CostPatch::Ingredient{
+      query.value(1).toInt(),
+      query.value(2).toInt(),
+      query.value(3).toDouble(),
+      query.value(4).toInt()
+    };
+  }
+
+  void set_entries(int row, const std::vector<Entry> &entries)
+  {
+    int first = offsets[row];
+    int last = offsets[row + 1];
+    int count = entries.size();
+    resize_span(ingredient_ids, first, last, count);
+    resize_span(columns, first, last, count);
+    resize_span(quantities, first, last, count);
+    for (int i = 0; i < count; i++)
+    {
+      ingredient_ids[first + i] = entries[i].ingredient;
+      columns[first + i] = entries[i].column;
+      quantities[first + i] = entries[i].quantity;
+    }
+    shift_offsets(offsets, row, count - (last - first));
+  }
+
+  // Recomputes the staple words of row from its entries
+  void set_words(int row)
+  {
+    std::vector<int> indexes;
+    std::vector<quint64> bits;
+    row_words(row, indexes, bits);
+    int first = word_offsets[row];
+    int last = word_offsets[row + 1];
+    int count = indexes.size();
+    resize_span(word_indexes, first, last, count);
+    resize_span(word_bits, first, last, count);
+    std::copy(indexes.begin(), indexes.end(), word_indexes.begin() + first);
+    std::copy(bits.begin(), bits.end(), word_bits.begin() + first);
+    shift_offsets(word_offsets, row, count - (last - first));
+  }
+
+  // An empty row for id at row, before the row there now
+  void insert_row(int row, int id)
+  {
+    recipe_ids.insert(recipe_ids.begin() + row, id);
+    offsets.insert(offsets.begin() + row + 1, offsets[row]);
+    word_offsets.insert(word_offsets.begin() + row + 1, word_offsets[row]);
+    staples.insert(staples.begin() + row, 0);
+    fresh.insert(fresh.begin() + row, 0);
+  }
+
+  void remove_row(int row)
+  {
+    set_entries(row, std::vector<Entry>());
+    set_words(row);
+    recipe_ids.erase(recipe_ids.begin() + row);
+    offsets.erase(offsets.begin() + row + 1);
+    word_offsets.erase(word_offsets.begin() + row + 1);
+    staples.erase(staples.begin() + row);
+    fresh.erase(fresh.begin() + row);
+  }
+
+  // Replaces the rows of recipes, ascending ids, with their entries,
+  // adding rows for new recipes and removing those entries lacks. Other
+  // rows are left as they are, moving only to make room.
+  void replace_rows(const std::vector<int> &recipes, const QHash<int, std::vector<CostPatch::Ingredient>> &entries)
+  {
+    int moved = recipe_ids.size();
+    for (int id : recipes)
+    {
+      int row = std::lower_bound(recipe_ids.begin(), recipe_ids.end(), id) - recipe_ids.begin();
+      bool present = row < int(recipe_ids.size()) && recipe_ids[row] == id;
+      auto found = entries.constFind(id);
+      if (found == entries.constEnd())
+      {
+        if (present)
+        {
+          remove_row(row);
+          rows.remove(id);
+          moved = std::min(moved, row);
+        }
+        continue;
+      }
+      if (!present)
+      {
+        insert_row(row, id);
+        moved = std::min(moved, row);
+      }
+      std::vector<Entry> loaded;
+      for (auto &ingredient : found.value())
+      {
+        Entry entry;
+        if (make_entry(ingredient, entry))
+          loaded.push_back(entry);
+      }
+      set_entries(row, loaded);
+      set_words(row);
+      row_costs(row, prices.data(), 1, &staples[row], &fresh[row]);
+    }
+    for (int row = moved; row < int(recipe_ids.size()); row++)
+      rows.insert(recipe_ids[row], row);
+  }
+
+  // Recipes whose rows hold any of ingredients
+  QList<int> entry_recipes(const QSet<qint64> &ingredients) const
+  {
+    QList<int> result;
+    if (ingredients.isEmpty())
+      return result;
+    for (int row = 0; row < int(recipe_ids.size()); row++)
+    {
+      for (int entry = offsets[row]; entry < offsets[row + 1]; entry++)
+      {
+        if (ingredients.contains(ingredient_ids[entry]))
+        {
+          result.append(recipe_ids[row]);
+          break;
+        }
+      }
+    }
+    return result;
+  }
+
+  void row_costs(int row, const double *prices, int scenarios, double *staples, double *fresh) const
+  {
+    std::fill(staples, staples + scenarios, 0.0);
+    std::fill(fresh, fresh + scenarios, 0.0);
+    for (int entry = offsets[row]; entry < offsets[row + 1]; entry++)
+    {
+      int column = columns[entry];
+      const double *price = prices + size_t(column) * scenarios;
+      // a staple is bought whole, whatever the quantity
+      if (staple(column))
+      {
+        for (int s = 0; s < scenarios; s++)
+          staples[s] += price[s];
+      }
+      else
+      {
+        double quantity = quantities[entry];
+        for (int s = 0; s < scenarios; s++)
+          fresh[s] += quantity * price[s];
+      }
+    }
+  }
+
+  void update_costs()
+  {
+    staples.resize(recipe_ids.size());
+    fresh.resize(recipe_ids.size());
+    for (int row = 0; row < int(recipe_ids.size()); row++)
+      row_costs(row, prices.data(), 1, &staples[row], &fresh[row]);
+    update_words();
+    count_uses();
+  }
+
+  // Calls visit with each staple column of row once
+  template <typename Visit>
+  void each_staple(int row, Visit visit) const
+  {
+    for (int word = word_offsets[row]; word < word_offsets[row + 1]; word++)
+    {
+      for (quint64 bits = word_bits[word]; bits; bits &= bits - 1)
+        visit(word_indexes[word] * 64 + int(qCountTrailingZeroBits(bits)));
+    }
+  }
+
+  void use_row(int row, int delta)
+  {
+    each_staple(row, [&](int column)
+    {
+      uses[column] += delta;
+    });
+  }
+
+  void count_uses()
+  {
+    uses.assign(food_ids.size(), 0);
+    for (int id : planned)
+    {
+      auto found = rows.constFind(id);
+      if (found != rows.constEnd())
+        use_row(found.value(), 1);
+    }
+  }
+
+  // Planned recipes using column, besides row
+  int other_uses(int row, int column) const
+  {
+    return uses[column] - (planned.contains(recipe_ids[row]) ? 1 : 0);
+  }
+
+  // Appends the nonzero 64-column words of row's staple bitset, ascending
+  void row_words(int row, std::vector<int> &indexes, std::vector<quint64> &bits) const
+  {
+    std::vector<std::pair<int, quint64>> words;
+    for (int entry = offsets[row]; entry < offsets[row + 1]; entry++)
+    {
+      int column = columns[entry];
+      if (staple(column))
+        words.emplace_back(column >> 6, quint64(1) << (column & 63));
+    }
+    std::sort(words.begin(), words.end());
+    size_t first = indexes.size();
+    for (auto &word : words)
+    {
+      if (indexes.size() > first && indexes.back() == word.first)
+        bits.back() |= word.second;
+      else
+      {
+        indexes.push_back(word.first);
+        bits.push_back(word.second);
+      }
+    }
+  }
+
+  void update_words()
+  {
+    word_offsets.assign(1, 0);
+    word_indexes.clear();
+    word_bits.clear();
+    for (int row = 0; row < int(recipe_ids.size()); row++)
+    {
+      row_words(row, word_indexes, word_bits);
+      word_offsets.push_back(word_indexes.size());
+    }
+  }
+};
+
+CostEngine::CostEngine() : impl(std::make_unique<Impl>())
+{
+  impl->clear();
+}
+
+CostEngine::~CostEngine()
+{
+}
+
+bool CostEngine::load()
+{
+  QWriteLocker lock(&impl->lock);
+  impl->clear();
+  DbReader reader;
+  QSqlQuery query(db_connection());
+  query.setForwardOnly(true);
+  if (!query.exec("select id, staple, price, unit from foods order by id;"))
+    return false;
+  while (query.next())
+    impl->read_food(query);
+
+  if (!query.exec("select id, planned from recipes order by id;"))
+    return false;
+  while (query.next())
+  {
+    impl->rows.insert(query.value(0).toInt(), impl->recipe_ids.size());
+    impl->recipe_ids.push_back(query.value(0).toInt());
+    if (query.value(1).toInt() == 1)
+      impl->planned.insert(query.value(0).toInt());
+  }
+
+  if (!query.exec("select recipe, id, food, quantity, unit from ingredients order by recipe, id;"))
+    return false;
+  while (query.next())
+  {
+    int row = impl->rows.value(query.value(0).toInt(), -1);
+    Entry entry;
+    if (row < 0 || !impl->make_entry(Impl::read_ingredient(query), entry))
+      continue;
+    while (int(impl->offsets.size()) <= row)
+      impl->offsets.push_back(impl->columns.size());
+    impl->append(entry);
+  }
+  while (impl->offsets.size() <= impl->recipe_ids.size())
+    impl->offsets.push_back(impl->columns.size());
+
+  impl->update_costs();
+  return true;
+}
+
+std::shared_ptr<CostPatch> CostEngine::read(const DbChanges &changes) const
+{
+  QReadLocker lock(&impl->lock);
+  DbTableChanges recipes = changes.value("recipes");
+  DbTableChanges foods = changes.value("foods");
+  DbTableChanges ingredients = changes.value("ingredients");
+  if (recipes.reset || foods.reset || ingredients.reset)
+    return nullptr;
+  DbReader reader;
+  auto patch = std::make_shared<CostPatch>();
+  if (!query_ids("select id, staple, price, unit from foods where id in (%1);", id_list(foods.inserted + foods.updated), [&](const QSqlQuery &query)
+      {
+        patch->foods.push_back(CostPatch::Food{
+            query.value(0).toInt(),
+            query.value(1).toInt() == 1,
+            query.value(2).toDouble(),
+            query.value(3).toInt()
+            });
+      }))
+    return nullptr;
+
+  // moved or removed ingredients are found by their entries, added ones by
+  // query, and a food's price, staple flag or unit touches every recipe using it
+  QSet<int> affected;
+  for (qint64 id : recipes.inserted + recipes.deleted)
+    affected.insert(int(id));
+  for (int id : impl->entry_recipes(ingredients.updated + ingredients.deleted))
+    affected.insert(id);
+  auto add_recipe = [&](const QSqlQuery &query)
+  {
+    affected.insert(query.value(0).toInt());
+  };
+  if (!query_ids("select recipe from ingredients where id in (%1);", id_list(ingredients.inserted + ingredients.updated), add_recipe)
+      || !query_ids("select distinct recipe from ingredients where food in (%1);", id_list(foods.updated), add_recipe))
+    return nullptr;
+
+  // the rows to replace, and every planned state the changes name
+  QList<int> named = affected.values();
+  for (qint64 id : recipes.updated)
+    named.append(int(id));
+  for (int id : named)
+    patch->planned.insert(id, false);
+  if (!query_ids("select id, planned from recipes where id in (%1);", named, [&](const QSqlQuery &query)
+      {
+        int id = query.value(0).toInt();
+        patch->planned.insert(id, query.value(1).toInt() == 1);
+        if (affected.contains(id))
+          patch->entries.insert(id, std::vector<CostPatch::Ingredient>());
+      }))
+    return nullptr;
+  if (!query_ids(
+        "select recipe, id, food, quantity, unit from ingredients where recipe in (%1) order by recipe, id;",
+        affected.values(),
+        [&](const QSqlQuery &query)
+        {
+          auto found = patch->entries.find(query.value(0).toInt());
+          if (found != patch->entries.end())
+            found.value().push_back(Impl::read_ingredient(query));
+        }))
+    return nullptr;
+  patch->recipes.assign(affected.begin(), affected.end());
+  std::sort(patch->recipes.begin(), patch->recipes.end());
+  return patch;
+}
+
+void CostEngine::patch(const CostPatch &patch)
+{
+  QWriteLocker lock(&impl->lock);
+  // planned rows being replaced give back their staple counts, and take
+  // them again from their new entries
+  auto use_replaced = [&](int delta)
+  {
+    for (int id : patch.recipes)
+    {
+      int row = recipe_row(id);
+      if (row >= 0 && impl->planned.contains(id))
+        impl->use_row(row, delta);
+    }
+  };
+  use_replaced(-1);
+
+  for (auto &food : patch.foods)
+    impl->set_food(food.id, food.staple, food.price, food.unit);
+  impl->uses.resize(impl->food_ids.size(), 0);
+
+  // planning a recipe only moves its counts
+  for (auto i = patch.planned.constBegin(); i != patch.planned.constEnd(); ++i)
+  {
+    if (i.value() == impl->planned.contains(i.key()))
+      continue;
+    if (i.value())
+      impl->planned.insert(i.key());
+    else
+      impl->planned.remove(i.key());
+    int row = recipe_row(i.key());
+    if (row >= 0 && !std::binary_search(patch.recipes.begin(), patch.recipes.end(), i.key()))
+      impl->use_row(row, i.value() ? 1 : -1);
+  }
+
+  impl->replace_rows(patch.recipes, patch.entries);
+  use_replaced(1);
+}
+
+int CostEngine::recipe_count() const
+{
+  return impl->recipe_ids.size();
+}
+
+int CostEngine::food_count() const
+{
+  return impl->food_ids.size();
+}
+
+int CostEngine::recipe_row(int id) const
+{
+  return impl->rows.value(id, -1);
+}
+
+int CostEngine::food_column(int id) const
+{
+  return impl->food_columns.value(id, -1);
+}
+
+int CostEngine::recipe_id(int row) const
+{
+  return impl->recipe_ids[row];
+}
+
+int CostEngine::food_id(int column) const
+{
+  return impl->food_ids[column];
+}
+
+const std::vector<double> &CostEngine::prices() const
+{
+  return impl->prices;
+}
+
+double CostEngine::staples(int row) const
+{
+  return impl->staples[row];
+}
+
+double CostEngine::fresh(int row) const
+{
+  return impl->fresh[row];
+}
+
+bool CostEngine::planned(int row) const
+{
+  return impl->planned.contains(impl->recipe_ids[row]);
+}
+
+QSet<int> CostEngine::planned_foods(const QSet<qint64> &ingredients, const QSet<qint64> &recipes) const
+{
+  QSet<int> result;
+  for (int id : impl->planned)
+  {
+    auto found = impl->rows.constFind(id);
+    if (found == impl->rows.constEnd())
+      continue;
+    int row = found.value();
+    bool whole = recipes.contains(id);
+    for (int entry = impl->offsets[row]; entry < impl->offsets[row + 1]; entry++)
+    {
+      if (whole || ingredients.contains(impl->ingredient_ids[entry]))
+        result.insert(impl->food_ids[impl->columns[entry]]);
+    }
+  }
+  return result;
+}
+
+double CostEngine::marginal(int row) const
+{
+  double result = impl->fresh[row];
+  impl->each_staple(row, [&](int column)
+  {
+    if (impl->other_uses(row, column) == 0)
+      result += impl->prices[column];
+  });
+  return result;
+}
+
+double CostEngine::shared(int row) const
+{
+  double result = impl->fresh[row];
+  impl->each_staple(row, [&](int column)
+  {
+    result += impl->prices[column] / (impl->other_uses(row, column) + 1);
+  });
+  return result;
+}
+
+void CostEngine::recipe_costs(const double *prices, int scenarios, double *staples, double *fresh, int first, int count) const
+{
+  int end = count < 0 ? recipe_count() : std::min(recipe_count(), first + count);
+  for (int row = first; row < end; row++)
+    impl->row_costs(row, prices, scenarios, staples + size_t(row) * scenarios, fresh + size_t(row) * scenarios);
+}
+
+void CostEngine::plan_costs(const QList<int> &rows, const double *prices, int scenarios, double *staples, double *fresh) const
+{
+  std::fill(staples, staples + scenarios, 0.0);
+  std::fill(fresh, fresh + scenarios, 0.0);
+  std::vector<quint64> bought(impl->staple_bits.size(), 0);
+  for (int row : rows)
+  {
+    for (int entry = impl->offsets[row]; entry < impl->offsets[row + 1]; entry++)
+    {
+      int column = impl->columns[entry];
+      const double *price = prices + size_t(column) * scenarios;
+      if (impl->staple(column))
+      {
+        quint64 bit = quint64(1) << (column & 63);
+        if (bought[column >> 6] & bit)
+          continue;
+        bought[column >> 6] |= bit;
+        for (int s = 0; s < scenarios; s++)
+          staples[s] += price[s];
+      }
+      else
+      {
+        double quantity = impl->quantities[entry];
+        for (int s = 0; s < scenarios; s++)
+          fresh[s] += quantity * price[s];
+      }
+    }
+  }
+}
+
+QList<CostSuggestion> CostEngine::suggest(const QList<int> &rows, const QList<int> &bought, int limit) const
+{
+  std::vector<quint64> have(impl->staple_bits.size(), 0);
+  std::vector<bool> planned(recipe_count(), false);
+  for (int row : rows)
+  {
+    planned[row] = true;
+    for (int word = impl->word_offsets[row]; word < impl->word_offsets[row + 1]; word++)
+      have[impl->word_indexes[word]] |= impl->word_bits[word];
+  }
+  for (int column : bought)
+  {
+    if (impl->staple(column))
+      have[column >> 6] |= quint64(1) << (column & 63);
+  }
+
+  std::vector<CostSuggestion> found;
+  for (int row = 0; row < recipe_count(); row++)
+  {
+    if (planned[row])
+      continue;
+    int shared = 0;
+    double cost = impl->fresh[row];
+    for (int word = impl->word_offsets[row]; word < impl->word_offsets[row + 1]; word++)
+    {
+      int index = impl->word_indexes[word];
+      quint64 bits = impl->word_bits[word];
+      shared += qPopulationCount(bits & have[index]);
+      // only staples still to buy need their prices looked up
+      for (quint64 missing = bits & ~have[index]; missing; missing &= missing - 1)
+        cost += impl->prices[index * 64 + qCountTrailingZeroBits(missing)];
+    }
+    if (shared > 0)
+      found.push_back(CostSuggestion{impl->recipe_ids[row], cost, shared});
+  }
+
+  int kept = std::min(limit, int(found.size()));
+  std::partial_sort(found.begin(), found.begin() + kept, found.end(), [](const CostSuggestion &a, const CostSuggestion &b)
+  {
+    if (a.cost != b.cost)
+      return a.cost < b.cost;
+    if (a.shared != b.shared)
+      return a.shared > b.shared;
+    return a.id < b.id;
+  });
+  QList<CostSuggestion> result;
+  for (int i = 0; i < kept; i++)
+    result.append(found[i]);
+  return result;
+}
+
+QList<CostSuggestion> CostEngine::suggest_ids(const QList<int> &recipes, const QList<int> &foods, int limit) const
+{
+  QReadLocker lock(&impl->lock);
+  QList<int> rows;
+  for (int id : recipes)
+  {
+    int row = recipe_row(id);
+    if (row >= 0)
+      rows.append(row);
+  }
+  QList<int> bought;
+  for (int id : foods)
+  {
+    int column = food_column(id);
+    if (column >= 0)
+      bought.append(column);
+  }
+  return suggest(rows, bought, limit);
+}
@@ -0,0 +1,102 @@
+
+#ifndef costengine_h
+#define costengine_h
+
+#include "dbnotifier.h"
+
+#include <QList>
+#include <QSet>
+#include <memory>
+#include <vector>
+
+// The ingredients table held in memory as a compressed sparse row matrix:
+// one row per recipe in id order, one column per food, each entry an
+// ingredient quantity in the food's purchase unit, with a bit per column marking staples. Costs are
+// computed from price vectors in memory, so what-if prices never touch
+// the database. recipe_costs and db_generate_planned_groceries price
+// ingredients the same way.
+//
+// Kernels that take several scenarios read prices food-major, scenario s
+// of column c at prices[c * scenarios + s], and write costs the same way
+// per recipe, so the innermost loop runs over contiguous scenarios.
+// Database rows a set of changes touches, read by CostEngine::read
+struct CostPatch;
+
+struct CostSuggestion
+{
+  int id;
+  // fresh ingredients plus staples not already bought
+  double cost;
+  // staples already bought
+  int shared;
+};
+
+class CostEngine
+{
+  public:
+    CostEngine();
+    ~CostEngine();
+
+    // Reads recipes, foods and ingredients through a DbReader
+    bool load();
+    // Reads the rows and columns changes touch through a DbReader, under a
+    // read lock, so it may run on a read thread. Null when the changes
+    // reset a table or the read fails, and only a load will do.
+    std::shared_ptr<CostPatch> read(const DbChanges&) const;
+    // Applies a read under the write lock, replacing only the rows it names
+    // and recomputing only their costs and staple bitsets. Reads must be
+    // patched in the order they were made, one at a time.
+    void patch(const CostPatch&);
+
+    int recipe_count() const;
+    int food_count() const;
+    // -1 when absent
+    int recipe_row(int id) const;
+    int food_column(int id) const;
+    int recipe_id(int row) const;
+    int food_id(int column) const;
+
+    // Stored prices by column
+    const std::vector<double> &prices() const;
+    // Per-recipe costs at the stored prices, kept current by patch
+    double staples(int row) const;
+    double fresh(int row) const;
+
+    // Attribution of the plan's cost as db_generate_planned_groceries buys
+    // it, from per-staple counts of planned recipes that patch updates as
+    // recipes are planned or removed. marginal is what the recipe adds to
+    // the rest of the plan: its fresh ingredients and the staples no other
+    // planned recipe uses. shared splits each staple evenly between the
+    // recipes using it, its Shapley value when staples are bought once.
+    // Rows outside the plan are priced as if they joined it.
+    bool planned(int row) const;
+    double marginal(int row) const;
+    double shared(int row) const;
+
+    // Food ids that planned recipes hold for any of ingredients, or for any
+    // ingredient of recipes; called before and after patch, they give the
+    // foods whose generated groceries a change can touch
+    QSet<int> planned_foods(const QSet<qint64> &ingredients, const QSet<qint64> &recipes) const;
+
+    // staples and fresh hold recipe_count() * scenarios costs, of which
+    // count rows from first are written (all rows when count is negative),
+    // so threads may fill disjoint ranges of the same buffers
+    void recipe_costs(const double *prices, int scenarios, double *staples, double *fresh, int first = 0, int count = -1) const;
+    // Totals of a plan given as rows, each staple bought once; staples and
+    // fresh hold scenarios costs
+    void plan_costs(const QList<int> &rows, const double *prices, int scenarios, double *staples, double *fresh) const;
+
+    // Recipes outside the plan given as rows that share a staple with it or
+    // with the bought columns, cheapest to add first, then most shared;
+    // overlap is scored on per-recipe staple bitsets kept current by patch
+    QList<CostSuggestion> suggest(const QList<int> &rows, const QList<int> &bought, int limit) const;
+    // suggest for a plan and bought foods given as ids, under a lock that
+    // load and patch take, so it may run on another thread than theirs
+    QList<CostSuggestion> suggest_ids(const QList<int> &recipes, const QList<int> &foods, int limit) const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif
@@ -1,103 +1,692 @@
 
 #include "database.h"
+#include "dbnotifier.h"
+#include "dbtrace.h"
+#include "dbworker.h"
+#include "units.h"
 
+#include <QCoreApplication>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
 #include <QSqlDatabase>
 #include <QVariant>
 #include <QSqlQuery>
 #include <QSqlError>
 
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
 namespace
 {
-  int schema_version = 0;
+  // Recomputes recipe_costs rows, completed by a where clause picking the recipes
+  const QString recipe_costs_update =
+    "update recipe_costs set (staples, fresh) = ("
+    "select"
+    " coalesce(sum(case f.staple when 1 then f.price else 0 end), 0),"
+    " coalesce(sum(case f.staple when 0 then i.quantity * f.price else 0 end), 0) "
+    "from ingredients i join foods f on f.id = i.food where i.recipe = recipe_costs.recipe) ";
+
+  // Quantity of ingredient i in the purchase unit of its food f, or in its
+  // dimension's default unit when f has none, as unit_factor computes it.
+  // Plain SQL, so triggers using it work on any connection.
+  const QString unit_quantity = unit_quantity_sql("i.quantity", "i.unit", "f.unit");
+
+  // recipe_costs_update with fresh quantities converted to each food's
+  // purchase unit, which its price is per
+  const QString recipe_costs_unit_update =
+    "update recipe_costs set (staples, fresh) = ("
+    "select"
+    " coalesce(sum(case f.staple when 1 then f.price else 0 end), 0),"
+    " coalesce(sum(case f.staple when 0 then " + unit_quantity + " * f.price else 0 end), 0) "
+    "from ingredients i join foods f on f.id = i.food where i.recipe = recipe_costs.recipe) ";
+
+  // Generated grocery rows for the planned recipes, completed by a where
+  // clause on f. Staples are bought once; fresh quantities are summed in
+  // the food's purchase unit.
+  const QString planned_groceries_select =
+    "select 1, f.id, (case f.staple when 0 then sum(" + unit_quantity + ") else 1 end) "
+    "from recipes r cross join ingredients i on r.id = i.recipe join foods f on f.id = i.food where r.planned = 1 ";
+
+  // Recomputes the single grocery_totals row from scratch
+  const QString grocery_totals_rebuild =
+    "insert or replace into grocery_totals (id, staples, fresh) "
+    "select"
+    " 1,"
+    " coalesce(sum(case f.staple when 1 then g.quantity * f.price else 0 end), 0),"
+    " coalesce(sum(case f.staple when 0 then g.quantity * f.price else 0 end), 0) "
+    "from groceries g join foods f on f.id = g.food;";
+
+  // Adds (sign +) or subtracts (sign -) one grocery row, given as new or old
+  QString grocery_totals_adjust(QString sign, QString row)
+  {
+    return QString(
+      "update grocery_totals set (staples, fresh) = ("
+      "select"
+      " staples %1 (case f.staple when 1 then %2.quantity * f.price else 0 end),"
+      " fresh %1 (case f.staple when 0 then %2.quantity * f.price else 0 end) "
+      "from foods f where f.id = %2.food);").arg(sign).arg(row);
+  }
+
+  // Schema upgrades, applied in order on open. Entry i takes a database
+  // from version i to version i + 1. Only ever append to this list.
+  const QList<QStringList> migrations = {
+    {
+      "create index if not exists ingredients_recipe on ingredients (recipe, food, quantity);",
+      "create index if not exists ingredients_food on ingredients (food);",
+      "create index if not exists groceries_food on groceries (food, generated);",
+      "create index if not exists recipes_planned on recipes (id) where planned = 1;",
+    },
+    {
+      "delete from groceries where generated = 1 and id not in "
+      "(select min(id) from groceries where generated = 1 group by food);",
+      "create unique index if not exists groceries_generated on groceries (food) where generated = 1;",
+    },
+    {
+      "create table if not exists recipe_costs ("
+      "recipe integer primary key references recipes(id) on delete cascade,"
+      "staples real not null default 0,"
+      "fresh real not null default 0"
+      ");",
+      "insert or replace into recipe_costs (recipe, staples, fresh) "
+      "select"
+      " r.id,"
+      " coalesce(sum(case f.staple when 1 then f.price else 0 end), 0),"
+      " coalesce(sum(case f.staple when 0 then i.quantity * f.price else 0 end), 0) "
+      "from recipes r"
+      " left outer join ingredients i on r.id = i.recipe"
+      " left outer join foods f on f.id = i.food "
+      "group by r.id;",
+      "create trigger if not exists recipe_costs_recipe_add after insert on recipes begin "
+      "insert into recipe_costs (recipe) values (new.id); end;",
+      "create trigger if not exists recipe_costs_ingredient_add after insert on ingredients begin "
+      + recipe_costs_update + "where recipe = new.recipe; end;",
+      "create trigger if not exists recipe_costs_ingredient_remove after delete on ingredients begin "
+      + recipe_costs_update + "where recipe = old.recipe; end;",
+      "create trigger if not exists recipe_costs_ingredient_update after update of recipe, food, quantity on ingredients begin "
+      + recipe_costs_update + "where recipe in (old.recipe, new.recipe); end;",
+      "create trigger if not exists recipe_costs_food_update after update of staple, price on foods begin "
+      + recipe_costs_update + "where recipe in (select recipe from ingredients where food = new.id); end;",
+    },
+    {
+      "create table if not exists grocery_totals ("
+      "id integer primary key check (id = 1),"
+      "staples real not null default 0,"
+      "fresh real not null default 0"
+      ");",
+      grocery_totals_rebuild,
+      "create trigger if not exists grocery_totals_add after insert on groceries begin "
+      + grocery_totals_adjust("+", "new") + " end;",
+      "create trigger if not exists grocery_totals_remove after delete on groceries begin "
+      + grocery_totals_adjust("-", "old") + " end;",
+      "create trigger if not exists grocery_totals_update after update of food, quantity on groceries begin "
+      + grocery_totals_adjust("-", "old") + grocery_totals_adjust("+", "new") + " end;",
+      "create trigger if not exists grocery_totals_food_update after update of staple, price on foods begin "
+      "update grocery_totals set (staples, fresh) = ("
+      "select"
+      " staples + (case new.staple when 1 then q * new.price else 0 end) - (case old.staple when 1 then q * old.price else 0 end),"
+      " fresh + (case new.staple when 0 then q * new.price else 0 end) - (case old.staple when 0 then q * old.price else 0 end) "
+      "from (select coalesce(sum(quantity), 0) as q from groceries where food = new.id)); end;",
+    },
+    {
+      "alter table foods add column unit integer references units(id);",
+      // prices were entered for the quantities recipes used, most often in one unit
+      "update foods set unit = (select i.unit from ingredients i where i.food = foods.id and i.unit is not null "
+      "group by i.unit order by count(*) desc, i.unit limit 1);",
+      "create trigger foods_default_unit after insert on ingredients when new.unit is not null begin "
+      "update foods set unit = new.unit where id = new.food and unit is null; end;",
+      // the recipe editor adds ingredients without a unit and sets it after
+      "create trigger foods_default_unit_update after update of unit on ingredients when new.unit is not null begin "
+      "update foods set unit = new.unit where id = new.food and unit is null; end;",
+      "drop trigger recipe_costs_ingredient_add;",
+      "drop trigger recipe_costs_ingredient_remove;",
+      "drop trigger recipe_costs_ingredient_update;",
+      "drop trigger recipe_costs_food_update;",
+      "create trigger recipe_costs_ingredient_add after insert on ingredients begin "
+      + recipe_costs_unit_update + "where recipe = new.recipe; end;",
+      "create trigger recipe_costs_ingredient_remove after delete on ingredients begin "
+      + recipe_costs_unit_update + "where recipe = old.recipe; end;",
+      "create trigger recipe_costs_ingredient_update after update of recipe, food, unit, quantity on ingredients begin "
+      + recipe_costs_unit_update + "where recipe in (old.recipe, new.recipe); end;",
+      "create trigger recipe_costs_food_update after update of staple, price, unit on foods begin "
+      + recipe_costs_unit_update + "where recipe in (select recipe from ingredients where food = new.id); end;",
+      recipe_costs_unit_update + ";",
+      "delete from groceries where generated = 1;",
+      "insert into groceries (generated, food, quantity) " + planned_groceries_select + "group by f.id;",
+    },
+  };
+
+  const int schema_version = migrations.size();
+
+  // Food names of the recipe whose id is the placeholder, space separated
+  const QString recipe_foods_text =
+    "(select coalesce(group_concat(f.name, ' '), '') "
+    "from ingredients i join foods f on f.id = i.food where i.recipe = %1)";
+
+  // Full-text index over recipe names, steps and ingredient food names,
+  // keyed by recipe id and kept current by triggers. It is created outside
+  // the migrations since SQLite may be built without FTS5.
+  const QStringList recipe_search_schema = {
+    "create virtual table recipe_search using fts5("
+    "name, steps, foods, tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3');",
+    "create trigger recipe_search_recipe_insert after insert on recipes begin "
+    "insert into recipe_search (rowid, name, steps, foods) values (new.id, new.name, new.steps, ''); end;",
+    "create trigger recipe_search_recipe_update after update of name, steps on recipes begin "
+    "update recipe_search set name = new.name, steps = new.steps where rowid = new.id; end;",
+    "create trigger recipe_search_recipe_delete after delete on recipes begin "
+    "delete from recipe_search where rowid = old.id; end;",
+    QString(
+      "create trigger recipe_search_ingredient_insert after insert on ingredients begin "
+      "update recipe_search set foods = %1 where rowid = new.recipe; end;").arg(recipe_foods_text.arg("new.recipe")),
+    QString(
+      "create trigger recipe_search_ingredient_delete after delete on ingredients begin "
+      "update recipe_search set foods = %1 where rowid = old.recipe; end;").arg(recipe_foods_text.arg("old.recipe")),
+    QString(
+      "create trigger recipe_search_ingredient_update after update of recipe, food on ingredients begin "
+      "update recipe_search set foods = %1 where rowid in (old.recipe, new.recipe); end;")
+      .arg(recipe_foods_text.arg("recipe_search.rowid")),
+    QString(
+      "create trigger recipe_search_food_update after update of name on foods begin "
+      "update recipe_search set foods = %1 where rowid in (select recipe from ingredients where food = new.id); end;")
+      .arg(recipe_foods_text.arg("recipe_search.rowid")),
+    QString(
+      "insert into recipe_search (rowid, name, steps, foods) select r.id, r.name, r.steps, %1 from recipes r;")
+      .arg(recipe_foods_text.arg("r.id")),
+  };
+  // results per search
+  const int recipe_search_limit = 200;
+  bool search_available = false;
+  // ids per delete, under SQLite's default limit of 999 bound parameters
+  const int remove_ids_chunk = 500;
   bool initialized = false;
+  DbNotifier *notifier = nullptr;
+  DbWorker *worker = nullptr;
+
+  const char *worker_connection = "worker";
+  // connection used by db_* calls on this thread, the default one when empty
+  thread_local QString thread_connection;
+  // database name and options shared by every connection
+  QString database_name;
+  QString connect_options;
+  bool in_memory = false;
+
+  // Tuning applied to every connection, picked by name before db_init.
+  // synchronous = normal only risks the last commits on power loss in WAL mode.
+  struct Profile
+  {
+    QString name;
+    QStringList pragmas;
+  };
+  const QList<Profile> profiles = {
+    {"default", {}},
+    {
+      "desktop",
+      {
+        "pragma cache_size = -65536;",
+        "pragma mmap_size = 268435456;",
+        "pragma synchronous = normal;",
+        "pragma temp_store = memory;",
+      }
+    },
+    {
+      "small",
+      {
+        "pragma cache_size = -1024;",
+        "pragma mmap_size = 0;",
+        "pragma synchronous = normal;",
+        "pragma temp_store = file;",
+      }
+    },
+    {
+      "safe",
+      {
+        "pragma synchronous = full;",
+      }
+    },
+  };
+  QStringList profile_pragmas;
+
+  // Read-only queries timed before and after maintenance
+  const QList<QPair<QString, QString>> maintenance_queries = {
+    {
+      "planned ingredients",
+      "select i.food, sum(" + unit_quantity + ") "
+      "from ingredients i join recipes r on r.id = i.recipe join foods f on f.id = i.food "
+      "where r.planned = 1 group by i.food;"
+    },
+    {
+      "grocery list",
+      "select f.name, g.quantity, g.quantity * f.price, g.generated "
+      "from groceries g join foods f on f.id = g.food order by f.name, g.id;"
+    },
+    {"cheapest recipes", "select recipe, staples + fresh from recipe_costs order by staples + fresh limit 50;"},
+    {"food names", "select name from foods order by name;"},
+  };
+  const int maintenance_runs = 5;
+
+  enum class Operation
+  {
+    field_by_id,
+    id_by_field,
+    set_field_by_id,
+    remove_id,
+    field_list,
+    add_name,
+    recipe_foods,
+    upsert_planned_grocery,
+    remove_unplanned_grocery,
+    add_ingredient,
+    add_grocery,
+    upsert_food
+  };
+
+  // Prepared statements are kept per (connection, table, field, operation)
+  // and rebound on each call instead of being parsed again.
+  // Each query is only used on its connection's thread; the mutex guards the map.
+  typedef std::tuple<QString, QString, QString, Operation> StatementKey;
+  std::map<StatementKey, std::unique_ptr<QSqlQuery>> statements;
+  DbStatementCacheStats statement_stats = {0, 0};
+  QMutex statements_mutex;
+
+  bool db_open(QString name)
+  {
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+    db.setDatabaseName(database_name);
+    db.setConnectOptions(connect_options);
+    if (!db.open())
+      return false;
+    QSqlQuery query(db);
+    if (!query.exec("pragma foreign_keys = on;"))
+      return false;
+    for (auto pragma : profile_pragmas)
+    {
+      if (!query.exec(pragma))
+        qWarning("Unable to apply %s: %s", qPrintable(pragma), qPrintable(query.lastError().text()));
+    }
+    // shared-cache readers would otherwise wait on the writer's table locks
+    return !in_memory || query.exec("pragma read_uncommitted = 1;");
+  }
+
+  // Read-only connections, one per thread that checks a reader out. Each
+  // stays open until its thread exits; size caps how many are checked out
+  // at once.
+  struct ReaderPool
+  {
+    QMutex mutex;
+    QWaitCondition released;
+    int size = 4;
+    int in_use = 0;
+    int peak = 0;
+    quint64 checkouts = 0;
+    quint64 waits = 0;
+    qint64 wait_ns = 0;
+    int next = 0;
+    // bumped by db_close, so connections to a closed database are replaced
+    int generation = 0;
+    QStringList open;
+  };
+  ReaderPool readers;
+  // runs db_read work, from db_start_worker to db_close
+  QThreadPool *read_threads = nullptr;
+
+  void db_forget_statements(QString connection)
+  {
+    QMutexLocker lock(&statements_mutex);
+    for (auto i = statements.begin(); i != statements.end();)
+    {
+      if (std::get<0>(i->first) == connection)
+        i = statements.erase(i);
+      else
+        i++;
+    }
+  }
+
+  // This thread's reader connection and how deeply it is checked out,
+  // removed on the thread itself when it exits
+  struct ThreadReader
+  {
+    QString name;
+    int generation = 0;
+    int depth = 0;
+
+    ~ThreadReader()
+    {
+      close();
+    }
+
+    bool open(int generation_)
+    {
+      {
+        QMutexLocker lock(&readers.mutex);
+        name = QString("reader-%1").arg(readers.next++);
+        readers.open.append(name);
+      }
+      generation = generation_;
+      if (db_open(name) && QSqlQuery("pragma query_only = 1;", QSqlDatabase::database(name)).isActive())
+      {
+        if (db_trace_enabled())
+          db_trace_attach(QSqlDatabase::database(name));
+        return true;
+      }
+      qWarning("Unable to open reader connection %s", qPrintable(name));
+      close();
+      return false;
+    }
+
+    void close()
+    {
+      if (name.isEmpty())
+        return;
+      {
+        QSqlDatabase db = QSqlDatabase::database(name, false);
+        db_trace_detach(db);
+        db.close();
+      }
+      db_forget_statements(name);
+      QSqlDatabase::removeDatabase(name);
+      QMutexLocker lock(&readers.mutex);
+      readers.open.removeAll(name);
+      name.clear();
+    }
+  };
+  thread_local ThreadReader thread_reader;
+
+  class ReadTask : public QRunnable
+  {
+    public:
+      ReadTask(std::function<void()> work_) : work(work_)
+      {
+      }
+
+      void run() override
+      {
+        DbReader reader;
+        work();
+      }
+
+    private:
+      std::function<void()> work;
+  };
+
+  qint64 db_pragma(QString name)
+  {
+    QSqlQuery query(QString("pragma %1;").arg(name), db_connection());
+    return query.next() ? query.value(0).toLongLong() : -1;
+  }
+
+  // Bytes on disk including the WAL, or in pages for an in-memory database
+  qint64 db_size()
+  {
+    if (in_memory)
+      return db_pragma("page_count") * db_pragma("page_size");
+    return QFileInfo(database_name).size() + QFileInfo(database_name + "-wal").size();
+  }
+
+  // Median milliseconds of each maintenance query
+  QList<double> db_time_queries()
+  {
+    QList<double> result;
+    QSqlQuery query(db_connection());
+    query.setForwardOnly(true);
+    for (auto named : maintenance_queries)
+    {
+      std::vector<qint64> nsecs;
+      QElapsedTimer timer;
+      for (int i = 0; i < maintenance_runs; i++)
+      {
+        timer.start();
+        if (query.exec(named.second))
+        {
+          while (query.next())
+            ;
+        }
+        nsecs.push_back(timer.nsecsElapsed());
+      }
+      std::sort(nsecs.begin(), nsecs.end());
+      result.append(nsecs[nsecs.size() / 2] / 1e6);
+    }
+    return result;
+  }
+
+  QString db_statement_text(Operation operation, QString table, QString field)
+  {
+    switch (operation)
+    {
+      case Operation::field_by_id:
+        return QString("select %1 from %2 where id = :id;").arg(field).arg(table);
+      case Operation::id_by_field:
+        return QString("select id from %1 where %2 = :value;").arg(table).arg(field);
+      case Operation::set_field_by_id:
+        return QString("update %1 set %2 = :value where id = :id;").arg(table).arg(field);
+      case Operation::remove_id:
+        return QString("delete from %1 where id = :id;").arg(table);
+      case Operation::field_list:
+        return QString("select %1 from %2;").arg(field).arg(table);
+      case Operation::add_name:
+        return QString("insert into %1 (name) values (:name);").arg(table);
+      case Operation::recipe_foods:
+        return "select distinct food from ingredients where recipe = :recipe;";
+      case Operation::upsert_planned_grocery:
+        return
+          "insert into groceries (generated, food, quantity) " + planned_groceries_select +
+          "and f.id = :food "
+          "group by f.id "
+          "on conflict (food) where generated = 1 do update set quantity = excluded.quantity;";
+      case Operation::remove_unplanned_grocery:
+        return
+          "delete from groceries where generated = 1 and food = :food and food not in "
+          "(select i.food from ingredients i join recipes r on r.id = i.recipe "
+          "where r.planned = 1 and i.food = groceries.food);";
+      case Operation::add_ingredient:
+        return
+          "insert into ingredients (recipe, food, unit, quantity) "
+          "values (:recipe, :food, :unit, coalesce(:quantity, 0));";
+      case Operation::add_grocery:
+        return "insert into groceries (food, quantity) values (:food, :quantity);";
+      case Operation::upsert_food:
+        // null staple or price keeps the stored value; unchanged rows are not rewritten
+        return
+          "insert into foods (name, staple, price) values (:name, coalesce(:staple, 0), coalesce(:price, 0)) "
+          "on conflict (name) do update set staple = coalesce(:staple, staple), price = coalesce(:price, price) "
+          "where coalesce(:staple, staple) is not staple or coalesce(:price, price) is not price;";
+    }
+    return QString();
+  }
+
+  QSqlQuery *db_statement(Operation operation, QString table, QString field = QString())
+  {
+    QSqlDatabase db = db_connection();
+    StatementKey key(db.connectionName(), table, field, operation);
+    QMutexLocker lock(&statements_mutex);
+    auto found = statements.find(key);
+    if (found != statements.end())
+    {
+      statement_stats.hits++;
+      return found->second.get();
+    }
+    statement_stats.misses++;
+    std::unique_ptr<QSqlQuery> query(new QSqlQuery(db));
+    if (!query->prepare(db_statement_text(operation, table, field)))
+    {
+      qWarning("Unable to prepare statement: %s", qPrintable(query->lastError().text()));
+      return nullptr;
+    }
+    return (statements[key] = std::move(query)).get();
+  }
 
   bool db_init_units()
   {
     QString statement;
-    QSqlQuery query;
-
-    statement =
-      "insert into units (name) values"
-      "('pinch'),"
-      "('teaspoon'),"
-      "('tablespoon'),"
-      "('cup'),"
-      "('quart'),"
-      "('pint'),"
-      "('gallon'),"
-      "('ounce'),"
-      "('pound');";
+    QSqlQuery query(db_connection());
+
+    QStringList values;
+    for (int i = 0; i < unit_count; i++)
+      values.append(QString("(%1, '%2')").arg(i + 1).arg(unit_definitions[i].name));
+    statement = "insert into units (id, name) values " + values.join(",") + ";";
     if (!query.exec(statement))
       return false;
     return true;
   }
 
-  QMap<QString, int> db_name_id_map(QString table)
+  // Runs statement, logging any error
+  bool db_exec(QString statement)
   {
-    QMap<QString, int> result;
-    QSqlQuery query(QString("select name, id from %1;").arg(table));
-    while (query.next())
-      result.insert(query.value(0).toString(), query.value(1).toInt());
-    return result;
+    QSqlQuery query(db_connection());
+    if (query.exec(statement))
+      return true;
+    qWarning("Statement failed: %s", qPrintable(query.lastError().text()));
+    return false;
   }
 
   int db_schema_version()
   {
-    QSqlQuery query("select value from schema_versions order by value asc limit 1;");
-    if (query.next())
+    QSqlQuery query("select max(value) from schema_versions;", db_connection());
+    if (query.next() && !query.value(0).isNull())
       return query.value(0).toInt();
     return -1;
   }
 
   bool db_set_field_by_id(int id, QString table, QString field, QVariant value)
   {
-    QSqlQuery query;
-    if (!query.prepare(QString("update %1 set %2 = :value where id = :id;").arg(table).arg(field)))
+    QSqlQuery *query = db_statement(Operation::set_field_by_id, table, field);
+    if (!query)
       return false;
-    query.bindValue(":value", value);
-    query.bindValue(":id", id);
-    return query.exec();
+    query->bindValue(":value", value);
+    query->bindValue(":id", id);
+    return query->exec();
   }
 
   int db_id_by_field(QString table, QString field, QVariant value)
   {
-    QSqlQuery query;
-    if (!query.prepare(QString("select id from %1 where %2 = :value;").arg(table).arg(field)))
+    QSqlQuery *query = db_statement(Operation::id_by_field, table, field);
+    if (!query)
       return -1;
-    query.bindValue(":value", value);
-    if (!query.exec() || !query.next())
-      return -1;
-    return query.value(0).toInt();
+    query->bindValue(":value", value);
+    int id = -1;
+    if (query->exec() && query->next())
+      id = query->value(0).toInt();
+    query->finish();
+    return id;
   }
 
-  bool db_set_schema_version()
+  bool db_set_schema_version(int version)
   {
-    QSqlQuery query;
+    QSqlQuery query(db_connection());
     if (!query.prepare("insert into schema_versions (value) values (?)"))
       return false;
-    query.addBindValue(QVariant(schema_version));
+    query.addBindValue(QVariant(version));
     return query.exec();
   }
 
+  bool db_migrate(int from)
+  {
+    QSqlDatabase db = db_connection();
+    for (int version = from; version < schema_version; version++)
+    {
+      if (!db.transaction())
+        return false;
+      QSqlQuery query(db_connection());
+      bool ok = true;
+      for (auto statement : migrations[version])
+      {
+        ok = query.exec(statement);
+        if (!ok)
+        {
+          qWarning("Schema migration to version %d failed: %s", version + 1, qPrintable(query.lastError().text()));
+          break;
+        }
+      }
+      if (!ok || !db_set_schema_version(version + 1) || !db.commit())
+      {
+        db.rollback();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Creates recipe_search on first open; false when FTS5 is missing
+  bool db_init_search()
+  {
+    QSqlDatabase db = db_connection();
+    QSqlQuery query(db);
+    if (query.exec("select 1 from sqlite_master where name = 'recipe_search';") && query.next())
+      return true;
+    if (!db.transaction())
+      return false;
+    for (auto statement : recipe_search_schema)
+    {
+      if (!query.exec(statement))
+      {
+        qWarning("Full-text search unavailable, recipe search will scan: %s", qPrintable(query.lastError().text()));
+        db.rollback();
+        return false;
+      }
+    }
+    return db.commit();
+  }
+
+  // "word"* for each word, so every word must prefix-match something
+  QString db_search_expression(QString text)
+  {
+    QStringList terms;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    for (auto word : text.split(' ', Qt::SkipEmptyParts))
+#else
+    for (auto word : text.split(' ', QString::SkipEmptyParts))
+#endif
+      terms.append("\"" + word.replace("\"", "\"\"") + "\"*");
+    return terms.join(' ');
+  }
+
   QVariant db_field_by_id(QString table, QString field, int id)
   {
-    QSqlQuery query;
-    if (!query.prepare(QString("select %1 from %2 where id = :id").arg(field).arg(table)))
+    QSqlQuery *query = db_statement(Operation::field_by_id, table, field);
+    if (!query)
       return QVariant();
-    query.bindValue(":id", id);
-    if (!query.exec() || !query.next())
-      return QVariant();
-    return query.value(0);
+    query->bindValue(":id", id);
+    QVariant result;
+    if (query->exec() && query->next())
+      result = query->value(0);
+    query->finish();
+    return result;
   }
 
   QStringList db_field_list(QString table, QString field)
   {
     QStringList result;
-    QSqlQuery query(QString("select %1 from %2;").arg(field).arg(table));
-    while (query.next())
-      result.append(query.value(0).toString());
+    QSqlQuery *query = db_statement(Operation::field_list, table, field);
+    if (!query || !query->exec())
+      return result;
+    while (query->next())
+      result.append(query->value(0).toString());
+    query->finish();
     return result;
   }
+
+  int db_add_name(QString table, QString name)
+  {
+    QSqlQuery *query = db_statement(Operation::add_name, table);
+    if (!query)
+      return -1;
+    query->bindValue(":name", name);
+    return query->exec() ? query->lastInsertId().toInt() : -1;
+  }
+}
+
+QSqlDatabase db_connection()
+{
+  if (!thread_connection.isEmpty())
+    return QSqlDatabase::database(thread_connection);
+  return QSqlDatabase::database();
 }
 
 bool db_init(QString src)
@@ -106,15 +695,33 @@ bool db_init(QString src)
     return false;
   initialized = true;
 
-  QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
-  if (src.length())
-    db.setDatabaseName(src);
+  // a named shared-cache database lets the worker connection see the same in-memory data
+  in_memory = src.isEmpty();
+  if (in_memory)
+  {
+    database_name = QString("file:budget-meal-planner-%1?mode=memory&cache=shared").arg(QCoreApplication::applicationPid());
+    connect_options = "QSQLITE_OPEN_URI";
+  }
   else
-    db.setDatabaseName(":memory:");
-  if (!db.open())
+  {
+    database_name = src;
+    connect_options = QString();
+  }
+  if (!db_open(QSqlDatabase::defaultConnection))
     return false;
+  QSqlDatabase db = db_connection();
+
+  // readers see the last commit instead of waiting on the writer; a new
+  // file also gets incremental vacuum, which must be set before any table
+  if (!in_memory)
+  {
+    QSqlQuery(db).exec("pragma auto_vacuum = incremental;");
+    QSqlQuery wal("pragma journal_mode = wal;", db);
+    if (!wal.next() || wal.value(0).toString() != "wal")
+      qWarning("Unable to enable write-ahead logging, readers will wait on writes");
+  }
 
-  QSqlQuery query("pragma foreign_keys = on;");
+  QSqlQuery query(db);
   QString statement;
 
   statement = 
@@ -127,8 +734,6 @@ bool db_init(QString src)
 
   int current_version = db_schema_version();
   bool fresh = current_version < 0;
-  if (current_version < schema_version && !db_set_schema_version())
-    return false;
 
   statement =
     "create table if not exists units ("
@@ -182,43 +787,252 @@ bool db_init(QString src)
   if (!query.exec(statement))
     return false;
 
-  if (fresh && !db_init_units())
+  if (fresh && (!db_init_units() || !db_set_schema_version(0)))
+    return false;
+
+  if (!db_migrate(fresh ? 0 : current_version))
     return false;
+  search_available = db_init_search();
+
+  notifier = new DbNotifier();
+  return notifier->attach(db);
+}
+
+void db_close()
+{
+  // read threads close their readers as they exit
+  delete read_threads;
+  read_threads = nullptr;
+  delete worker;
+  worker = nullptr;
+  if (notifier)
+    notifier->detach(QSqlDatabase::database());
+  delete notifier;
+  notifier = nullptr;
+  db_trace_detach(QSqlDatabase::database());
+  db_forget_statements(QSqlDatabase::defaultConnection);
+  QSqlDatabase::database().close();
+  QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+  // other threads' readers belong to them and are replaced on their next checkout
+  if (thread_reader.depth == 0)
+    thread_reader.close();
+  {
+    QMutexLocker lock(&readers.mutex);
+    readers.generation++;
+    readers.peak = readers.in_use;
+    readers.checkouts = 0;
+    readers.waits = 0;
+    readers.wait_ns = 0;
+  }
+  initialized = false;
+}
 
-  return true;
+DbReader::DbReader() : previous(thread_connection), held(false), valid(false)
+{
+  if (!initialized)
+    return;
+  held = true;
+  if (thread_reader.depth > 0)
+  {
+    // nested checkouts on one thread share its connection
+    thread_reader.depth++;
+    valid = !thread_reader.name.isEmpty();
+    return;
+  }
+
+  int generation;
+  {
+    QMutexLocker lock(&readers.mutex);
+    if (readers.in_use >= readers.size)
+    {
+      QElapsedTimer timer;
+      timer.start();
+      readers.waits++;
+      while (readers.in_use >= readers.size)
+        readers.released.wait(&readers.mutex);
+      readers.wait_ns += timer.nsecsElapsed();
+    }
+    readers.in_use++;
+    readers.peak = std::max(readers.peak, readers.in_use);
+    readers.checkouts++;
+    generation = readers.generation;
+  }
+
+  if (thread_reader.generation != generation)
+    thread_reader.close();
+  // a failed open is retried on the next checkout; until then db_* calls
+  // stay on this thread's usual connection
+  valid = !thread_reader.name.isEmpty() || thread_reader.open(generation);
+  if (valid)
+    thread_connection = thread_reader.name;
+  thread_reader.depth = 1;
+}
+
+DbReader::~DbReader()
+{
+  if (!held)
+    return;
+  thread_connection = previous;
+  if (--thread_reader.depth > 0)
+    return;
+  QMutexLocker lock(&readers.mutex);
+  readers.in_use--;
+  readers.released.wakeOne();
+}
+
+bool DbReader::ok() const
+{
+  return valid;
+}
+
+void db_set_reader_pool_size(int size)
+{
+  QMutexLocker lock(&readers.mutex);
+  readers.size = std::max(1, size);
+  readers.released.wakeAll();
+  if (read_threads)
+    read_threads->setMaxThreadCount(readers.size);
 }
 
-QMap<QString, int> db_unit_id_map()
+void db_read(std::function<void()> work)
 {
-  return db_name_id_map("units");
+  if (read_threads)
+    read_threads->start(new ReadTask(work));
+  else
+  {
+    DbReader reader;
+    work();
+  }
+}
+
+bool db_reading_async()
+{
+  return read_threads != nullptr;
+}
+
+DbReaderPoolStats db_reader_pool_stats()
+{
+  QMutexLocker lock(&readers.mutex);
+  return DbReaderPoolStats{
+    readers.size,
+    readers.open.size(),
+    readers.in_use,
+    readers.peak,
+    readers.checkouts,
+    readers.waits,
+    readers.wait_ns
+  };
+}
+
+bool db_start_worker()
+{
+  if (!initialized || worker)
+    return false;
+  bool trace = db_trace_enabled();
+  worker = new DbWorker([trace]()
+  {
+    thread_connection = worker_connection;
+    if (!db_open(worker_connection))
+      return false;
+    QSqlDatabase db = db_connection();
+    if (trace)
+      db_trace_attach(db);
+    return notifier->attach(db);
+  },
+  []()
+  {
+    {
+      QSqlDatabase db = db_connection();
+      notifier->detach(db);
+      db_trace_detach(db);
+      db_forget_statements(worker_connection);
+      db.close();
+    }
+    QSqlDatabase::removeDatabase(worker_connection);
+  },
+  []()
+  {
+    // the work's commits have returned, so readers will see them
+    notifier->publish(db_connection());
+  });
+  if (worker->started())
+  {
+    // threads are kept so each keeps its reader connection between reads
+    read_threads = new QThreadPool();
+    read_threads->setExpiryTimeout(-1);
+    QMutexLocker lock(&readers.mutex);
+    read_threads->setMaxThreadCount(readers.size);
+    return true;
+  }
+  delete worker;
+  worker = nullptr;
+  return false;
 }
 
-QMap<QString, int> db_food_id_map()
+DbWorker *db_worker()
 {
-  return db_name_id_map("foods");
+  return worker;
 }
 
-QMap<QString, int> db_recipe_id_map()
+DbNotifier *db_notifier()
 {
-  return db_name_id_map("recipes");
+  return notifier;
 }
 
 int db_add_recipe(QString name)
 {
-  QSqlQuery query;
-  if (!query.prepare("insert into recipes (name) values (:name);"))
-    return -1;
-  query.bindValue(":name", name);
-  return query.exec() ? query.lastInsertId().toInt() : -1;
+  return db_add_name("recipes", name);
 }
 
 bool db_remove_id(QString table, int id)
 {
-  QSqlQuery query;
-  if (!query.prepare(QString("delete from %1 where id = :id;").arg(table)))
+  QSqlQuery *query = db_statement(Operation::remove_id, table);
+  if (!query)
     return false;
-  query.bindValue(":id", id);
-  return query.exec();
+  query->bindValue(":id", id);
+  return query->exec();
+}
+
+bool db_remove_ids(QString table, QList<int> ids, QString *error)
+{
+  if (ids.isEmpty())
+    return true;
+  QSqlDatabase db = db_connection();
+  if (!db.transaction())
+  {
+    if (error)
+      *error = db.lastError().text();
+    return false;
+  }
+  QSqlQuery query(db_connection());
+  for (int first = 0; first < ids.size(); first += remove_ids_chunk)
+  {
+    QList<int> chunk = ids.mid(first, remove_ids_chunk);
+    QString params = QString("?,").repeated(chunk.size());
+    params.chop(1);
+    bool ok = query.prepare(QString("delete from %1 where id in (%2);").arg(table).arg(params));
+    for (int id : chunk)
+      query.addBindValue(id);
+    if (!ok || !query.exec())
+    {
+      // rows still referenced elsewhere fail their foreign keys here
+      qWarning("Unable to remove from %s: %s", qPrintable(table), qPrintable(query.lastError().text()));
+      if (error)
+        *error = query.lastError().text();
+      db.rollback();
+      return false;
+    }
+  }
+  if (db.commit())
+    return true;
+  if (error)
+    *error = db.lastError().text();
+  return false;
+}
+
+QVariant db_name(QString table, int id)
+{
+  return db_field_by_id(table, "name", id);
 }
 
 QString db_recipe_name(int id)
@@ -261,40 +1075,326 @@ int db_recipe_id(QString name)
   return db_id_by_field("recipes", "name", name);
 }
 
+int db_unit_id(QString name)
+{
+  return db_id_by_field("units", "name", name);
+}
+
 int db_add_food(QString name)
 {
-  QSqlQuery query;
-  if (!query.prepare("insert into foods (name) values (:name);"))
+  return db_add_name("foods", name);
+}
+
+int db_add_ingredient(int recipe, int food)
+{
+  return db_add_ingredient(recipe, food, QVariant(), QVariant());
+}
+
+int db_add_ingredient(int recipe, int food, QVariant unit, QVariant quantity)
+{
+  QSqlQuery *query = db_statement(Operation::add_ingredient, "ingredients");
+  if (!query)
     return -1;
-  query.bindValue(":name", name);
-  return query.exec() ? query.lastInsertId().toInt() : -1;
+  query->bindValue(":recipe", recipe);
+  query->bindValue(":food", food);
+  query->bindValue(":unit", unit);
+  query->bindValue(":quantity", quantity);
+  return query->exec() ? query->lastInsertId().toInt() : -1;
 }
 
-void db_clear_planned_groceries()
+int db_upsert_food(QString name, QVariant staple, QVariant price)
 {
-  QSqlQuery query("delete from groceries where generated = 1;");
+  QSqlQuery *query = db_statement(Operation::upsert_food, "foods");
+  if (!query)
+    return -1;
+  query->bindValue(":name", name);
+  query->bindValue(":staple", staple);
+  query->bindValue(":price", price);
+  if (!query->exec())
+    return -1;
+  return db_food_id(name);
 }
 
-void db_generate_planned_groceries()
+int db_add_grocery(int food, double quantity)
 {
-  QSqlQuery query(
-      "insert into groceries (generated, food, quantity) "
-      "select 1, f.id, (case f.staple when 0 then sum(i.quantity) else 1 end) "
-      "from recipes r join ingredients i on r.id = i.recipe join foods f on f.id = i.food where r.planned = 1 "
-      "group by f.id;"
-      );
+  QSqlQuery *query = db_statement(Operation::add_grocery, "groceries");
+  if (!query)
+    return -1;
+  query->bindValue(":food", food);
+  query->bindValue(":quantity", quantity);
+  return query->exec() ? query->lastInsertId().toInt() : -1;
 }
 
-bool db_add_planned(int recipe)
+bool db_set_field(QString table, int id, QString field, QVariant value)
 {
-  QSqlQuery query;
-  if (!query.prepare("update recipes set planned = 1 where id = :id"))
+  return db_set_field_by_id(id, table, field, value);
+}
+
+bool db_clear_planned_groceries()
+{
+  return db_exec("delete from groceries where generated = 1;");
+}
+
+bool db_generate_planned_groceries()
+{
+  // cross join pins recipes as the outer loop so recipes_planned drives the scan
+  return db_exec("insert into groceries (generated, food, quantity) " + planned_groceries_select + "group by f.id;");
+}
+
+bool db_update_planned_groceries(QList<int> foods)
+{
+  QSqlQuery *upsert = db_statement(Operation::upsert_planned_grocery, "groceries", "food");
+  QSqlQuery *remove = db_statement(Operation::remove_unplanned_grocery, "groceries", "food");
+  if (!upsert || !remove)
     return false;
-  query.bindValue(":id", recipe);
-  return query.exec();
+
+  QSqlDatabase db = db_connection();
+  if (!db.transaction())
+    return false;
+  for (int food : foods)
+  {
+    upsert->bindValue(":food", food);
+    remove->bindValue(":food", food);
+    if (!upsert->exec() || !remove->exec())
+    {
+      db.rollback();
+      return false;
+    }
+  }
+  return db.commit();
+}
+
+QList<int> db_recipe_foods(int recipe)
+{
+  QList<int> result;
+  QSqlQuery *query = db_statement(Operation::recipe_foods, "ingredients", "recipe");
+  if (!query)
+    return result;
+  query->bindValue(":recipe", recipe);
+  if (!query->exec())
+    return result;
+  while (query->next())
+    result.append(query->value(0).toInt());
+  query->finish();
+  return result;
+}
+
+QList<int> db_planned_recipes()
+{
+  QList<int> result;
+  QSqlQuery query(db_connection());
+  query.setForwardOnly(true);
+  if (!query.exec("select id from recipes where planned = 1 order by id;"))
+    return result;
+  while (query.next())
+    result.append(query.value(0).toInt());
+  return result;
+}
+
+QList<int> db_grocery_foods()
+{
+  QList<int> result;
+  QSqlQuery query(db_connection());
+  query.setForwardOnly(true);
+  if (!query.exec("select distinct food from groceries order by food;"))
+    return result;
+  while (query.next())
+    result.append(query.value(0).toInt());
+  return result;
 }
 
-void db_clear_planned()
+QList<DbPlanRecipe> db_plan_recipes()
 {
-  QSqlQuery query("update recipes set planned = 0;");
+  QList<DbPlanRecipe> result;
+  QHash<int, int> positions;
+  QSqlQuery query(db_connection());
+  query.setForwardOnly(true);
+  if (!query.exec("select r.id, r.meals, c.fresh from recipes r join recipe_costs c on c.recipe = r.id order by r.id;"))
+    return result;
+  while (query.next())
+  {
+    positions.insert(query.value(0).toInt(), result.size());
+    result.append(DbPlanRecipe{query.value(0).toInt(), query.value(1).toDouble(), query.value(2).toDouble(), {}});
+  }
+  if (!query.exec(
+        "select distinct i.recipe, i.food from ingredients i join foods f on f.id = i.food "
+        "where f.staple = 1 order by i.recipe, i.food;"))
+    return QList<DbPlanRecipe>();
+  while (query.next())
+  {
+    auto found = positions.constFind(query.value(0).toInt());
+    if (found != positions.constEnd())
+      result[found.value()].staples.append(query.value(1).toInt());
+  }
+  return result;
+}
+
+QHash<int, double> db_staple_prices()
+{
+  QHash<int, double> result;
+  QSqlQuery query("select id, price from foods where staple = 1;", db_connection());
+  while (query.next())
+    result.insert(query.value(0).toInt(), query.value(1).toDouble());
+  return result;
+}
+
+bool db_recipe_planned(int recipe)
+{
+  return db_field_by_id("recipes", "planned", recipe).toInt() == 1;
+}
+
+bool db_add_planned(int recipe)
+{
+  return db_set_field_by_id(recipe, "recipes", "planned", 1);
+}
+
+bool db_remove_planned(int recipe)
+{
+  return db_set_field_by_id(recipe, "recipes", "planned", 0);
+}
+
+bool db_clear_planned()
+{
+  return db_exec("update recipes set planned = 0;");
+}
+
+bool db_rebuild_grocery_totals()
+{
+  return db_exec(grocery_totals_rebuild);
+}
+
+QList<DbGrocery> db_grocery_list()
+{
+  QList<DbGrocery> result;
+  QSqlQuery query(db_connection());
+  query.setForwardOnly(true);
+  if (!query.exec(
+        "select f.name, g.quantity, g.quantity * f.price, g.generated "
+        "from groceries g join foods f on f.id = g.food order by f.name, g.id;"))
+    return result;
+  while (query.next())
+  {
+    result.append(DbGrocery{
+        query.value(0).toString(),
+        query.value(1).toDouble(),
+        query.value(2).toDouble(),
+        query.value(3).toBool()
+        });
+  }
+  return result;
+}
+
+DbGroceryTotals db_grocery_totals()
+{
+  DbGroceryTotals result{0, 0};
+  QSqlQuery query("select staples, fresh from grocery_totals where id = 1;", db_connection());
+  if (query.next())
+  {
+    result.staples = query.value(0).toDouble();
+    result.fresh = query.value(1).toDouble();
+  }
+  return result;
+}
+
+DbStatementCacheStats db_statement_cache_stats()
+{
+  QMutexLocker lock(&statements_mutex);
+  return statement_stats;
+}
+
+QStringList db_profile_names()
+{
+  QStringList result;
+  for (auto profile : profiles)
+    result.append(profile.name);
+  return result;
+}
+
+bool db_set_profile(QString name)
+{
+  for (auto profile : profiles)
+  {
+    if (profile.name == name)
+    {
+      profile_pragmas = profile.pragmas;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool db_maintain(DbMaintenance &report)
+{
+  report.bytes_before = db_size();
+  report.free_pages_before = db_pragma("freelist_count");
+  QList<double> before = db_time_queries();
+
+  bool ok = db_exec("analyze;");
+  // switching an older file to incremental vacuum takes one full vacuum
+  report.vacuumed = db_pragma("auto_vacuum") != 2;
+  if (report.vacuumed)
+    ok = db_exec("pragma auto_vacuum = incremental;") && db_exec("vacuum;") && ok;
+  else
+    ok = db_exec("pragma incremental_vacuum;") && ok;
+  ok = db_exec("pragma optimize;") && ok;
+  if (!in_memory)
+    ok = db_exec("pragma wal_checkpoint(truncate);") && ok;
+
+  report.bytes_after = db_size();
+  report.free_pages_after = db_pragma("freelist_count");
+  QList<double> after = db_time_queries();
+  report.timings.clear();
+  for (int i = 0; i < maintenance_queries.size(); i++)
+    report.timings.append(DbQueryTiming{maintenance_queries[i].first, before[i], after[i]});
+  return ok;
+}
+
+bool db_search_available()
+{
+  return search_available;
+}
+
+QList<DbRecipeMatch> db_search_recipes(QString text)
+{
+  QList<DbRecipeMatch> result;
+  QString expression = db_search_expression(text);
+  if (expression.isEmpty())
+    return result;
+
+  QSqlQuery query(db_connection());
+  query.setForwardOnly(true);
+  if (search_available)
+  {
+    // names weigh most, then food names, then steps
+    query.prepare(
+        "select s.rowid, r.name, c.staples, c.fresh, snippet(recipe_search, -1, '[', ']', '...', 8) "
+        "from recipe_search s join recipes r on r.id = s.rowid join recipe_costs c on c.recipe = s.rowid "
+        "where recipe_search match :expression order by bm25(recipe_search, 10.0, 1.0, 3.0) limit :limit;");
+    query.bindValue(":expression", expression);
+  }
+  else
+  {
+    query.prepare(
+        "select r.id, r.name, c.staples, c.fresh, '' "
+        "from recipes r join recipe_costs c on c.recipe = r.id "
+        "where r.name like :pattern or r.steps like :pattern order by r.name limit :limit;");
+    query.bindValue(":pattern", "%" + text.trimmed() + "%");
+  }
+  query.bindValue(":limit", recipe_search_limit);
+  if (!query.exec())
+  {
+    qWarning("Recipe search failed: %s", qPrintable(query.lastError().text()));
+    return result;
+  }
+  while (query.next())
+  {
+    result.append(DbRecipeMatch{
+      query.value(0).toInt(),
+      query.value(1).toString(),
+      query.value(2).toDouble(),
+      query.value(3).toDouble(),
+      query.value(4).toString()
+    });
+  }
+  return result;
 }
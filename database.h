@@ -2,37 +2,183 @@
 #ifndef database_h
 #define database_h
 
+#include <QHash>
+#include <QList>
+#include <QSqlDatabase>
 #include <QString>
 #include <QStringList>
-#include <QMap>
+#include <QVariant>
+#include <functional>
 
-bool db_init(QString);
+class DbNotifier;
+class DbWorker;
+
+struct DbGrocery
+{
+  QString food;
+  double quantity;
+  double cost;
+  bool generated;
+};
+
+struct DbGroceryTotals
+{
+  double staples;
+  double fresh;
+};
+
+struct DbStatementCacheStats
+{
+  quint64 hits;
+  quint64 misses;
+};
+
+struct DbPlanRecipe
+{
+  int id;
+  double meals;
+  // cost of the non-staple ingredients
+  double fresh;
+  // staple food ids, each bought once per plan
+  QList<int> staples;
+};
+
+struct DbRecipeMatch
+{
+  int id;
+  QString name;
+  double staples;
+  double fresh;
+  // matching text with the matched words in brackets
+  QString snippet;
+};
+
+struct DbQueryTiming
+{
+  QString name;
+  double before_ms;
+  double after_ms;
+};
+
+struct DbMaintenance
+{
+  qint64 bytes_before;
+  qint64 bytes_after;
+  qint64 free_pages_before;
+  qint64 free_pages_after;
+  // true when a full vacuum ran instead of an incremental one
+  bool vacuumed;
+  QList<DbQueryTiming> timings;
+};
+
+struct DbReaderPoolStats
+{
+  int size;
+  int open;
+  int in_use;
+  int peak;
+  quint64 checkouts;
+  quint64 waits;
+  qint64 wait_ns;
+};
+
+// Points db_* calls on the constructing thread at its own read-only
+// connection while in scope. Waits while the pool's size readers are all
+// checked out; a file database runs in WAL mode so readers do not block
+// the writer.
+class DbReader
+{
+  public:
+    DbReader();
+    ~DbReader();
+    DbReader(const DbReader&) = delete;
+    DbReader &operator=(const DbReader&) = delete;
 
-QMap<QString, int> db_unit_id_map();
-QMap<QString, int> db_food_id_map();
-QMap<QString, int> db_recipe_id_map();
+    // false when the reader connection could not be opened
+    bool ok() const;
+
+  private:
+    QString previous;
+    bool held;
+    bool valid;
+};
+
+// Tuning pragmas for every connection, set before db_init; false if unknown
+QStringList db_profile_names();
+bool db_set_profile(QString);
+
+bool db_init(QString);
+void db_close();
+// The connection db_* calls on this thread use: the worker's on the worker
+// thread, a DbReader's while one is in scope, else the default one
+QSqlDatabase db_connection();
+DbNotifier *db_notifier();
+// Opens a second connection on a worker thread for writes posted to db_worker()
+bool db_start_worker();
+DbWorker *db_worker();
+void db_set_reader_pool_size(int);
+DbReaderPoolStats db_reader_pool_stats();
+// Runs work inside a DbReader on one of the read threads that
+// db_start_worker starts, alongside the worker and other reads; without
+// them it runs here and now
+void db_read(std::function<void()>);
+// true when db_read hands work to the read threads
+bool db_reading_async();
 
 QStringList db_food_names();
 QStringList db_recipe_names();
 
 int db_add_recipe(QString);
 int db_add_food(QString);
+int db_add_ingredient(int, int);
+int db_add_ingredient(int, int, QVariant, QVariant);
+int db_upsert_food(QString, QVariant, QVariant);
+int db_add_grocery(int, double);
 bool db_add_planned(int);
+bool db_remove_planned(int);
+bool db_recipe_planned(int);
 
 bool db_remove_id(QString, int);
+// All or none are removed; on failure error, if given, gets the reason
+bool db_remove_ids(QString, QList<int>, QString *error = nullptr);
+bool db_set_field(QString, int, QString, QVariant);
 
+QVariant db_name(QString, int);
 QString db_recipe_name(int);
 QString db_recipe_steps(int);
 
 int db_food_id(QString);
 int db_recipe_id(QString);
+int db_unit_id(QString);
 
 bool db_set_recipe_name(int, QString);
 bool db_set_recipe_steps(int, QString);
 
-void db_clear_planned();
-void db_clear_planned_groceries();
+bool db_clear_planned();
+bool db_clear_planned_groceries();
+
+bool db_generate_planned_groceries();
+bool db_update_planned_groceries(QList<int>);
+bool db_rebuild_grocery_totals();
+QList<DbGrocery> db_grocery_list();
+DbGroceryTotals db_grocery_totals();
+
+QList<int> db_recipe_foods(int);
+QList<int> db_planned_recipes();
+QList<int> db_grocery_foods();
+
+// Recipes with their costs split as db_generate_planned_groceries buys them
+QList<DbPlanRecipe> db_plan_recipes();
+QHash<int, double> db_staple_prices();
+
+// Ranked matches of every word in text against recipe names, steps and
+// ingredient food names; without FTS5, text is matched as-is with like
+bool db_search_available();
+QList<DbRecipeMatch> db_search_recipes(QString);
+
+DbStatementCacheStats db_statement_cache_stats();
 
-void db_generate_planned_groceries();
+// Analyzes, vacuums and optimizes, timing a few queries before and after
+bool db_maintain(DbMaintenance&);
 
 #endif
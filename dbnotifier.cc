@@ -0,0 +1,194 @@
+
+#include "dbnotifier.h"
+#include "sqlitehandle.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <memory>
+#include <vector>
+
+#include <sqlite3.h>
+
+namespace
+{
+  // past this many rows a table is reported as reset instead
+  const int tracked_rows_limit = 10000;
+
+  void merge(DbTableChanges &into, const DbTableChanges &from)
+  {
+    into.reset = into.reset || from.reset;
+    if (!into.reset)
+    {
+      into.inserted.unite(from.inserted);
+      into.updated.unite(from.updated);
+      into.deleted.unite(from.deleted);
+    }
+    if (into.reset || into.inserted.size() + into.updated.size() + into.deleted.size() > tracked_rows_limit)
+    {
+      into.reset = true;
+      into.inserted.clear();
+      into.updated.clear();
+      into.deleted.clear();
+    }
+  }
+}
+
+struct DbNotifier::Impl
+{
+  // hook context for one connection, which may live on any thread
+  struct Connection
+  {
+    Impl *impl;
+    sqlite3 *handle;
+    // changes of the open transaction
+    DbChanges pending;
+    // changes of transactions committing, until published, guarded by mutex
+    DbChanges committing;
+  };
+
+  DbNotifier *notifier;
+  std::vector<std::unique_ptr<Connection>> connections;
+  QMutex mutex;
+  // committed transactions not yet reported, guarded by mutex
+  DbChanges committed;
+  bool flush_scheduled = false;
+
+  Impl(DbNotifier *notifier_) : notifier(notifier_)
+  {
+  }
+
+  ~Impl()
+  {
+    for (auto &connection : connections)
+    {
+      sqlite3_update_hook(connection->handle, nullptr, nullptr);
+      sqlite3_commit_hook(connection->handle, nullptr, nullptr);
+      sqlite3_rollback_hook(connection->handle, nullptr, nullptr);
+    }
+  }
+
+  static void record(Connection *connection, int operation, const char *table, qint64 rowid)
+  {
+    DbTableChanges &changes = connection->pending[QString::fromUtf8(table)];
+    if (changes.reset)
+      return;
+    if (operation == SQLITE_INSERT)
+      changes.inserted.insert(rowid);
+    else if (operation == SQLITE_DELETE)
+      changes.deleted.insert(rowid);
+    else
+      changes.updated.insert(rowid);
+    if (changes.inserted.size() + changes.updated.size() + changes.deleted.size() > tracked_rows_limit)
+      merge(changes, DbTableChanges{{}, {}, {}, true});
+  }
+
+  void commit(Connection *connection)
+  {
+    QMutexLocker lock(&mutex);
+    for (auto i = connection->pending.constBegin(); i != connection->pending.constEnd(); i++)
+      merge(connection->committing[i.key()], i.value());
+    connection->pending.clear();
+  }
+
+  void publish(sqlite3 *handle)
+  {
+    QMutexLocker lock(&mutex);
+    for (auto &connection : connections)
+    {
+      if (connection->handle != handle)
+        continue;
+      for (auto i = connection->committing.constBegin(); i != connection->committing.constEnd(); i++)
+        merge(committed[i.key()], i.value());
+      connection->committing.clear();
+    }
+    if (committed.isEmpty() || flush_scheduled)
+      return;
+    flush_scheduled = true;
+    // runs on the notifier's thread whichever thread committed
+    QMetaObject::invokeMethod(notifier, [this]() { flush(); }, Qt::QueuedConnection);
+  }
+
+  void flush()
+  {
+    DbChanges changes;
+    {
+      QMutexLocker lock(&mutex);
+      changes.swap(committed);
+      flush_scheduled = false;
+    }
+    if (!changes.isEmpty())
+      emit notifier->changed(changes);
+  }
+
+  static void update_hook(void *self, int operation, const char*, const char *table, sqlite3_int64 rowid)
+  {
+    record(static_cast<Connection*>(self), operation, table, rowid);
+  }
+
+  static int commit_hook(void *self)
+  {
+    auto connection = static_cast<Connection*>(self);
+    connection->impl->commit(connection);
+    return 0;
+  }
+
+  static void rollback_hook(void *self)
+  {
+    static_cast<Connection*>(self)->pending.clear();
+  }
+};
+
+DbNotifier::DbNotifier(QObject *parent) :
+  QObject(parent),
+  impl(std::make_unique<Impl>(this))
+{
+}
+
+DbNotifier::~DbNotifier()
+{
+}
+
+bool DbNotifier::attach(QSqlDatabase db)
+{
+  sqlite3 *connection = db_sqlite_handle(db);
+  if (!connection)
+    return false;
+  QMutexLocker lock(&impl->mutex);
+  impl->connections.emplace_back(new Impl::Connection{impl.get(), connection, DbChanges(), DbChanges()});
+  Impl::Connection *context = impl->connections.back().get();
+  sqlite3_update_hook(connection, &Impl::update_hook, context);
+  sqlite3_commit_hook(connection, &Impl::commit_hook, context);
+  sqlite3_rollback_hook(connection, &Impl::rollback_hook, context);
+  return true;
+}
+
+void DbNotifier::detach(QSqlDatabase db)
+{
+  sqlite3 *connection = db_sqlite_handle(db);
+  QMutexLocker lock(&impl->mutex);
+  for (auto i = impl->connections.begin(); i != impl->connections.end(); i++)
+  {
+    if ((*i)->handle == connection)
+    {
+      sqlite3_update_hook(connection, nullptr, nullptr);
+      sqlite3_commit_hook(connection, nullptr, nullptr);
+      sqlite3_rollback_hook(connection, nullptr, nullptr);
+      impl->connections.erase(i);
+      return;
+    }
+  }
+}
+
+void DbNotifier::publish(QSqlDatabase db)
+{
+  impl->publish(db_sqlite_handle(db));
+}
+
+void DbNotifier::discard()
+{
+  QMutexLocker lock(&impl->mutex);
+  impl->committed.clear();
+  for (auto &connection : impl->connections)
+    connection->committing.clear();
+}
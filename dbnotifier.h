@@ -0,0 +1,48 @@
+
+#ifndef dbnotifier_h
+#define dbnotifier_h
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QSqlDatabase>
+#include <memory>
+
+struct DbTableChanges
+{
+  QSet<qint64> inserted;
+  QSet<qint64> updated;
+  QSet<qint64> deleted;
+  // set when too many rows changed to track individually
+  bool reset = false;
+};
+
+typedef QHash<QString, DbTableChanges> DbChanges;
+
+class DbNotifier : public QObject
+{
+  Q_OBJECT
+  public:
+    DbNotifier(QObject *parent = nullptr);
+    ~DbNotifier();
+
+    bool attach(QSqlDatabase);
+    // must be called before an attached connection closes
+    void detach(QSqlDatabase);
+    // Reports what the connection has committed. SQLite calls the commit
+    // hook before a commit is durable, so a reader refetching then could
+    // miss it; call this on the connection's thread once its commits return.
+    void publish(QSqlDatabase);
+    // drops committed changes not yet reported, for callers that reload everything anyway
+    void discard();
+
+  signals:
+    void changed(const DbChanges&);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif
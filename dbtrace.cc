@@ -0,0 +1,203 @@
+
+#include "dbtrace.h"
+#include "database.h"
+#include "sqlitehandle.h"
+
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+#include <sqlite3.h>
+
+namespace
+{
+  // most recent slow samples kept
+  const int slow_samples_limit = 200;
+
+  // trace callbacks run on whichever thread steps the statement
+  QMutex mutex;
+  QList<sqlite3*> connections;
+  QHash<QString, DbStatementTrace> statements;
+  QList<DbSlowSample> slow_samples;
+  qint64 slow_threshold_ns = 100 * 1000000LL;
+  // rows stepped so far by statements still running
+  QHash<sqlite3_stmt*, qint64> rows_returned;
+
+  void profile(sqlite3_stmt *stmt, qint64 ns)
+  {
+    QString sql = QString::fromUtf8(sqlite3_sql(stmt));
+    qint64 rows = sqlite3_stmt_readonly(stmt) ? 0 : sqlite3_changes(sqlite3_db_handle(stmt));
+
+    QMutexLocker lock(&mutex);
+    rows += rows_returned.take(stmt);
+    auto found = statements.find(sql);
+    if (found == statements.end())
+      found = statements.insert(sql, DbStatementTrace{sql, 0, 0, 0, 0, 0});
+    DbStatementTrace &trace = found.value();
+    trace.count++;
+    trace.total_ns += ns;
+    trace.max_ns = std::max(trace.max_ns, ns);
+    trace.rows += rows;
+    if (ns < slow_threshold_ns)
+      return;
+    trace.slow++;
+    char *expanded = sqlite3_expanded_sql(stmt);
+    slow_samples.append(DbSlowSample{expanded ? QString::fromUtf8(expanded) : sql, ns, rows, QDateTime::currentDateTime()});
+    sqlite3_free(expanded);
+    if (slow_samples.size() > slow_samples_limit)
+      slow_samples.removeFirst();
+  }
+
+  int trace(unsigned event, void*, void *p, void *x)
+  {
+    auto stmt = static_cast<sqlite3_stmt*>(p);
+    if (event == SQLITE_TRACE_ROW)
+    {
+      QMutexLocker lock(&mutex);
+      rows_returned[stmt]++;
+    }
+    else if (event == SQLITE_TRACE_PROFILE)
+      profile(stmt, *static_cast<sqlite3_int64*>(x));
+    return 0;
+  }
+
+  double msecs(qint64 ns)
+  {
+    return ns / 1e6;
+  }
+}
+
+bool db_trace_attach(QSqlDatabase db)
+{
+  sqlite3 *connection = db_sqlite_handle(db);
+  if (!connection)
+    return false;
+  if (sqlite3_trace_v2(connection, SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW, &trace, nullptr) != SQLITE_OK)
+    return false;
+  QMutexLocker lock(&mutex);
+  connections.append(connection);
+  return true;
+}
+
+void db_trace_detach(QSqlDatabase db)
+{
+  sqlite3 *connection = db_sqlite_handle(db);
+  QMutexLocker lock(&mutex);
+  if (connections.removeAll(connection) > 0)
+    sqlite3_trace_v2(connection, 0, nullptr, nullptr);
+}
+
+void db_trace_detach()
+{
+  QMutexLocker lock(&mutex);
+  for (auto connection : connections)
+    sqlite3_trace_v2(connection, 0, nullptr, nullptr);
+  connections.clear();
+  rows_returned.clear();
+}
+
+bool db_trace_enabled()
+{
+  QMutexLocker lock(&mutex);
+  return !connections.isEmpty();
+}
+
+void db_trace_set_slow_threshold(int msecs)
+{
+  QMutexLocker lock(&mutex);
+  slow_threshold_ns = msecs * 1000000LL;
+}
+
+void db_trace_reset()
+{
+  QMutexLocker lock(&mutex);
+  statements.clear();
+  slow_samples.clear();
+}
+
+QList<DbStatementTrace> db_trace_statements()
+{
+  QList<DbStatementTrace> result;
+  {
+    QMutexLocker lock(&mutex);
+    result = statements.values();
+  }
+  std::sort(result.begin(), result.end(), [](const DbStatementTrace &a, const DbStatementTrace &b)
+  {
+    return a.total_ns > b.total_ns;
+  });
+  return result;
+}
+
+QList<DbSlowSample> db_trace_slow_samples()
+{
+  QMutexLocker lock(&mutex);
+  return slow_samples;
+}
+
+QJsonObject db_trace_json()
+{
+  QJsonArray statements;
+  for (auto trace : db_trace_statements())
+  {
+    QJsonObject object;
+    object.insert("sql", trace.sql);
+    object.insert("count", double(trace.count));
+    object.insert("total_ms", msecs(trace.total_ns));
+    object.insert("mean_ms", msecs(trace.total_ns) / trace.count);
+    object.insert("max_ms", msecs(trace.max_ns));
+    object.insert("rows", double(trace.rows));
+    object.insert("slow", double(trace.slow));
+    statements.append(object);
+  }
+
+  QJsonArray slow;
+  for (auto sample : db_trace_slow_samples())
+  {
+    QJsonObject object;
+    object.insert("sql", sample.sql);
+    object.insert("ms", msecs(sample.ns));
+    object.insert("rows", double(sample.rows));
+    object.insert("at", sample.at.toString(Qt::ISODateWithMs));
+    slow.append(object);
+  }
+
+  DbStatementCacheStats cache = db_statement_cache_stats();
+  QJsonObject statement_cache;
+  statement_cache.insert("hits", double(cache.hits));
+  statement_cache.insert("misses", double(cache.misses));
+
+  DbReaderPoolStats pool = db_reader_pool_stats();
+  QJsonObject reader_pool;
+  reader_pool.insert("size", pool.size);
+  reader_pool.insert("open", pool.open);
+  reader_pool.insert("in_use", pool.in_use);
+  reader_pool.insert("peak", pool.peak);
+  reader_pool.insert("checkouts", double(pool.checkouts));
+  reader_pool.insert("waits", double(pool.waits));
+  reader_pool.insert("wait_ms", msecs(pool.wait_ns));
+
+  QJsonObject result;
+  {
+    QMutexLocker lock(&mutex);
+    result.insert("slow_threshold_ms", msecs(slow_threshold_ns));
+  }
+  result.insert("statement_cache", statement_cache);
+  result.insert("reader_pool", reader_pool);
+  result.insert("statements", statements);
+  result.insert("slow", slow);
+  return result;
+}
+
+bool db_trace_write(QString path)
+{
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+  return file.write(QJsonDocument(db_trace_json()).toJson()) >= 0;
+}
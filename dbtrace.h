@@ -0,0 +1,49 @@
+
+#ifndef dbtrace_h
+#define dbtrace_h
+
+#include <QDateTime>
+#include <QJsonObject>
+#include <QList>
+#include <QSqlDatabase>
+#include <QString>
+
+struct DbStatementTrace
+{
+  QString sql;
+  quint64 count;
+  qint64 total_ns;
+  qint64 max_ns;
+  // rows returned by reads plus rows changed by writes
+  qint64 rows;
+  quint64 slow;
+};
+
+struct DbSlowSample
+{
+  // with bound values substituted
+  QString sql;
+  qint64 ns;
+  qint64 rows;
+  QDateTime at;
+};
+
+// Profiles every statement run on attached connections. Tracing costs
+// nothing until a connection is attached.
+bool db_trace_attach(QSqlDatabase);
+// detaches one connection, which must be done before it closes, or all of them
+void db_trace_detach(QSqlDatabase);
+void db_trace_detach();
+bool db_trace_enabled();
+
+void db_trace_set_slow_threshold(int msecs);
+void db_trace_reset();
+
+// statements ordered by total time, most first; samples oldest first
+QList<DbStatementTrace> db_trace_statements();
+QList<DbSlowSample> db_trace_slow_samples();
+
+QJsonObject db_trace_json();
+bool db_trace_write(QString path);
+
+#endif
@@ -0,0 +1,146 @@
+
+#include "dbworker.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <deque>
+#include <vector>
+
+namespace
+{
+  struct Job
+  {
+    QString key;
+    std::function<std::shared_ptr<void>()> work;
+    // of this job and every queued job it replaced
+    std::vector<std::function<void(std::shared_ptr<void>)>> done;
+  };
+}
+
+struct DbWorker::Impl
+{
+  QMutex mutex;
+  QWaitCondition changed;
+  std::deque<Job> queue;
+  bool running = false;
+  bool stopping = false;
+  bool ready = false;
+  bool ok = false;
+  QThread *thread = nullptr;
+
+  void run(std::function<bool()> setup, std::function<void()> teardown, std::function<void()> finished)
+  {
+    bool opened = setup();
+    {
+      QMutexLocker lock(&mutex);
+      ready = true;
+      ok = opened;
+      changed.wakeAll();
+    }
+    while (opened)
+    {
+      Job job;
+      {
+        QMutexLocker lock(&mutex);
+        while (queue.empty() && !stopping)
+          changed.wait(&mutex);
+        if (queue.empty())
+          break;
+        job = std::move(queue.front());
+        queue.pop_front();
+        running = true;
+      }
+      std::shared_ptr<void> result = job.work();
+      finished();
+      for (auto &done : job.done)
+        done(result);
+      QMutexLocker lock(&mutex);
+      running = false;
+      changed.wakeAll();
+    }
+    teardown();
+  }
+};
+
+DbWorker::DbWorker(std::function<bool()> setup, std::function<void()> teardown, std::function<void()> finished) :
+  impl(std::make_unique<Impl>())
+{
+  Impl *self = impl.get();
+  impl->thread = QThread::create([self, setup, teardown, finished]() { self->run(setup, teardown, finished); });
+  impl->thread->setObjectName("database");
+  impl->thread->start();
+  QMutexLocker lock(&impl->mutex);
+  while (!impl->ready)
+    impl->changed.wait(&impl->mutex);
+}
+
+DbWorker::~DbWorker()
+{
+  {
+    QMutexLocker lock(&impl->mutex);
+    impl->stopping = true;
+    impl->changed.wakeAll();
+  }
+  impl->thread->wait();
+  delete impl->thread;
+}
+
+bool DbWorker::started() const
+{
+  QMutexLocker lock(&impl->mutex);
+  return impl->ok;
+}
+
+void DbWorker::post(QString key, std::function<void()> work)
+{
+  queue(key, [work]()
+  {
+    work();
+    return std::shared_ptr<void>();
+  },
+  nullptr);
+}
+
+void DbWorker::queue(QString key, std::function<std::shared_ptr<void>()> work, std::function<void(std::shared_ptr<void>)> done)
+{
+  QMutexLocker lock(&impl->mutex);
+  if (!key.isEmpty())
+  {
+    for (auto &job : impl->queue)
+    {
+      if (job.key == key)
+      {
+        job.work = work;
+        if (done)
+          job.done.push_back(done);
+        return;
+      }
+    }
+  }
+  impl->queue.push_back(Job{key, work, {}});
+  if (done)
+    impl->queue.back().done.push_back(done);
+  impl->changed.wakeAll();
+}
+
+void DbWorker::wait()
+{
+  QMutexLocker lock(&impl->mutex);
+  while (impl->ok && (!impl->queue.empty() || impl->running))
+    impl->changed.wait(&impl->mutex);
+}
+
+void db_post(QString key, std::function<void()> work)
+{
+  if (db_worker())
+  {
+    db_worker()->post(key, work);
+    return;
+  }
+  work();
+  if (db_notifier())
+    db_notifier()->publish(db_connection());
+}
@@ -0,0 +1,102 @@
+
+#ifndef dbworker_h
+#define dbworker_h
+
+#include "database.h"
+#include "dbnotifier.h"
+
+#include <QMetaObject>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <functional>
+#include <memory>
+
+// Runs database work in order on one dedicated thread. Work posted under a
+// key replaces queued work with the same key that has not started yet, in
+// that work's place in the queue, so rapid repeated edits collapse into the
+// last one without passing writes queued after the first. The replaced
+// work's done callbacks still run, with the replacement's result, so work
+// posted under one key must always have the same result type.
+class DbWorker
+{
+  public:
+    // setup and teardown run on the worker thread before and after all
+    // work, and finished after each piece of work, before its done callbacks
+    DbWorker(std::function<bool()> setup, std::function<void()> teardown, std::function<void()> finished);
+    // Finishes queued work, runs teardown and joins the thread
+    ~DbWorker();
+
+    // false if setup failed
+    bool started() const;
+
+    void post(QString key, std::function<void()> work);
+
+    // done runs on context's thread with work's result, unless context is gone
+    template <typename Result>
+    void post(QString key, std::function<Result()> work, QObject *context, std::function<void(Result)> done)
+    {
+      QPointer<QObject> receiver(context);
+      queue(key, [work]()
+      {
+        return std::shared_ptr<void>(std::make_shared<Result>(work()));
+      },
+      [receiver, done](std::shared_ptr<void> result)
+      {
+        if (receiver)
+          QMetaObject::invokeMethod(receiver, [done, result]() { done(*std::static_pointer_cast<Result>(result)); }, Qt::QueuedConnection);
+      });
+    }
+
+    // Blocks until all work posted so far has run
+    void wait();
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+    void queue(QString key, std::function<std::shared_ptr<void>()> work, std::function<void(std::shared_ptr<void>)> done);
+};
+
+// Posts work to db_worker(), or runs it right away when there is no worker
+void db_post(QString key, std::function<void()> work);
+
+template <typename Result>
+void db_post(QString key, std::function<Result()> work, QObject *context, std::function<void(Result)> done)
+{
+  if (db_worker())
+  {
+    db_worker()->post<Result>(key, work, context, done);
+    return;
+  }
+  Result result = work();
+  if (db_notifier())
+    db_notifier()->publish(db_connection());
+  done(result);
+}
+
+// Runs work through db_read and done on context's thread with its result,
+// unless context is gone; both run here and now without read threads
+template <typename Result>
+void db_read(std::function<Result()> work, QObject *context, std::function<void(Result)> done)
+{
+  if (!db_reading_async())
+  {
+    auto read = [&]()
+    {
+      DbReader reader;
+      return work();
+    };
+    done(read());
+    return;
+  }
+  QPointer<QObject> receiver(context);
+  db_read([work, receiver, done]()
+  {
+    Result result = work();
+    if (receiver)
+      QMetaObject::invokeMethod(receiver, [done, result]() { done(result); }, Qt::QueuedConnection);
+  });
+}
+
+#endif
@@ -0,0 +1,226 @@
+
+#include "importer.h"
+#include "database.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QVariant>
+
+namespace
+{
+  // rows per transaction
+  const int batch_rows = 10000;
+
+  typedef QHash<QString, QVariant> Record;
+
+  QVariant optional(const Record &record, QString key)
+  {
+    QVariant value = record.value(key);
+    if (value.type() == QVariant::String && value.toString().trimmed().isEmpty())
+      return QVariant();
+    return value;
+  }
+
+  // Recipe names are not unique; imported rows join the first recipe with
+  // their name. Names are read once per import, since recipes.name has no
+  // index to look each one up by.
+  QHash<QString, int> recipe_ids()
+  {
+    QHash<QString, int> result;
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    if (!query.exec("select id, name from recipes order by id;"))
+      return result;
+    while (query.next())
+    {
+      QString name = query.value(1).toString();
+      if (!result.contains(name))
+        result.insert(name, query.value(0).toInt());
+    }
+    return result;
+  }
+
+  int recipe_id(QString name, QHash<QString, int> &recipes)
+  {
+    auto found = recipes.constFind(name);
+    if (found != recipes.constEnd())
+      return found.value();
+    int id = db_add_recipe(name);
+    if (id >= 0)
+      recipes.insert(name, id);
+    return id;
+  }
+
+  bool import_record(const Record &record, QHash<QString, int> &recipes)
+  {
+    QString food = record.value("food").toString().trimmed();
+    QString recipe = record.value("recipe").toString().trimmed();
+    if (food.isEmpty() && recipe.isEmpty())
+      return false;
+
+    int food_id = -1;
+    if (!food.isEmpty())
+    {
+      food_id = db_upsert_food(food, optional(record, "staple"), optional(record, "price"));
+      if (food_id < 0)
+        return false;
+    }
+    if (recipe.isEmpty())
+      return true;
+
+    int id = recipe_id(recipe, recipes);
+    if (id < 0)
+      return false;
+    QVariant steps = optional(record, "steps");
+    if (!steps.isNull() && !db_set_recipe_steps(id, steps.toString()))
+      return false;
+    if (food_id < 0)
+      return true;
+
+    QVariant unit;
+    QString unit_name = record.value("unit").toString().trimmed();
+    if (!unit_name.isEmpty())
+    {
+      int unit_id = db_unit_id(unit_name);
+      if (unit_id < 0)
+        return false;
+      unit = unit_id;
+    }
+    return db_add_ingredient(id, food_id, unit, optional(record, "quantity")) >= 0;
+  }
+
+  // Calls next for each record until it returns false, committing every batch_rows records
+  template <typename Next>
+  bool import_records(Next next, ImportStats &stats)
+  {
+    QSqlDatabase db = QSqlDatabase::database();
+    QHash<QString, int> recipes = recipe_ids();
+    Record record;
+    int batched = 0;
+    if (!db.transaction())
+      return false;
+    while (next(record))
+    {
+      if (import_record(record, recipes))
+        stats.rows++;
+      else
+        stats.skipped++;
+      if (++batched == batch_rows)
+      {
+        batched = 0;
+        if (!db.commit() || !db.transaction())
+          return false;
+      }
+    }
+    return db.commit();
+  }
+
+  bool import_csv(QTextStream &in, ImportStats &stats)
+  {
+    QStringList header;
+    if (!read_csv_fields(in, header))
+      return false;
+    for (auto &name : header)
+      name = name.trimmed().toLower();
+    QStringList fields;
+    return import_records([&](Record &record)
+    {
+      if (!read_csv_fields(in, fields))
+        return false;
+      record.clear();
+      for (int i = 0; i < header.size() && i < fields.size(); i++)
+        record.insert(header[i], fields[i]);
+      return true;
+    }, stats);
+  }
+
+  bool import_json_lines(QTextStream &in, ImportStats &stats)
+  {
+    QString line;
+    return import_records([&](Record &record)
+    {
+      record.clear();
+      while (in.readLineInto(&line))
+      {
+        if (line.trimmed().isEmpty())
+          continue;
+        QJsonObject object = QJsonDocument::fromJson(line.toUtf8()).object();
+        for (auto key : object.keys())
+          record.insert(key.toLower(), object.value(key).toVariant());
+        return true;
+      }
+      return false;
+    }, stats);
+  }
+}
+
+bool import_file(QString path, ImportStats &stats)
+{
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    return false;
+  QTextStream in(&file);
+  in.setCodec("UTF-8");
+
+  QElapsedTimer timer;
+  timer.start();
+  bool ok;
+  if (QFileInfo(path).suffix().toLower() == "csv")
+    ok = import_csv(in, stats);
+  else
+    ok = import_json_lines(in, stats);
+  if (!ok)
+    QSqlDatabase::database().rollback();
+
+  // generated groceries and totals follow from the imported foods and ingredients
+  db_clear_planned_groceries();
+  db_generate_planned_groceries();
+  db_rebuild_grocery_totals();
+  stats.msecs = timer.elapsed();
+  return ok;
+}
+
+bool read_csv_fields(QTextStream &in, QStringList &fields)
+{
+  fields.clear();
+  QString line;
+  if (!in.readLineInto(&line))
+    return false;
+  QString field;
+  bool quoted = false;
+  for (int i = 0; ; i++)
+  {
+    if (i == line.size())
+    {
+      if (!quoted || !in.readLineInto(&line))
+        break;
+      field += '\n';
+      i = -1;
+      continue;
+    }
+    QChar c = line[i];
+    if (quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"')
+    {
+      field += c;
+      i++;
+    }
+    else if (c == '"')
+      quoted = !quoted;
+    else if (c == ',' && !quoted)
+    {
+      fields.append(field);
+      field.clear();
+    }
+    else
+      field += c;
+  }
+  fields.append(field);
+  return true;
+}
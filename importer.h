@@ -0,0 +1,27 @@
+
+#ifndef importer_h
+#define importer_h
+
+#include <QString>
+#include <QStringList>
+
+class QTextStream;
+
+struct ImportStats
+{
+  qint64 rows = 0;
+  qint64 skipped = 0;
+  qint64 msecs = 0;
+};
+
+// Streams foods, recipes and ingredients from a CSV file with a header row
+// (.csv) or from one JSON object per line (any other suffix). Recognized
+// fields are food, staple, price, recipe, steps, unit and quantity. Foods are
+// upserted by name; a row naming both a recipe and a food adds an ingredient.
+bool import_file(QString path, ImportStats&);
+
+// Reads one CSV record into fields, continuing onto following lines while a
+// quoted field spans them; false at end of input
+bool read_csv_fields(QTextStream&, QStringList&);
+
+#endif
@@ -1,10 +1,17 @@
 
 #include "appinit.h"
 #include "app.h"
+#include "cli.h"
+#include "options.h"
 
 int main(int argc, char **argv)
 {
-  AppInit init(argc, argv);
+  Options options = parse_options(argc, argv);
+  if (options.maintain)
+    return cli_maintain(argc, argv, options);
+  if (options.headless)
+    return cli_run(argc, argv, options);
+  AppInit init(argc, argv, options);
   App app;
   app.show();
   return init.exec();
@@ -0,0 +1,681 @@
+
+#include "models.h"
+#include "costengine.h"
+#include "database.h"
+#include "dbworker.h"
+#include "nameindex.h"
+
+#include <QSqlQuery>
+#include <QTimer>
+#include <QVariant>
+
+namespace
+{
+  const QStringList planned_columns = {"id", "name", "marginal", "shared"};
+  const QStringList recipe_columns = {"id", "name", "staples", "fresh"};
+  const QStringList estimate_columns = {"total", "staples", "fresh"};
+  const QStringList grocery_columns = {"id", "food", "quantity", "generated"};
+  const QStringList food_columns = {"id", "name", "staple", "price", "unit"};
+  const QStringList ingredient_columns = {"id", "recipe", "food", "unit", "quantity"};
+  const QStringList search_columns = {"id", "name", "staples", "fresh", "match"};
+  const QStringList search_sources = {"recipes", "recipe_costs", "ingredients", "foods"};
+  const QStringList suggestion_columns = {"id", "name", "adds", "shared"};
+  const QStringList suggestion_sources = {"recipes", "ingredients", "foods", "groceries"};
+  // suggestions listed at once
+  const int suggestion_limit = 50;
+  // changes within this long of each other share one refresh
+  const int suggestion_delay_ms = 200;
+  const QStringList scenario_columns = {"scenario", "recipe", "base", "cost", "change"};
+  const QStringList trace_columns = {"statement", "count", "total ms", "mean ms", "max ms", "rows", "slow"};
+
+  // Edits are written on the database worker; repeated edits to a field
+  // collapse into the last one while they wait
+  bool post_field(QString table, int id, QString field, QVariant value)
+  {
+    QString key = QString("set:%1:%2:%3").arg(table).arg(id).arg(field);
+    db_post(key, [table, id, field, value]()
+    {
+      db_set_field(table, id, field, value);
+    });
+    return true;
+  }
+
+  PlannedRow read_planned(const QSqlQuery &query)
+  {
+    return PlannedRow{query.value(0).toInt(), query.value(1).toString(), 0, 0};
+  }
+
+  RecipeRow read_recipe(const QSqlQuery &query)
+  {
+    return RecipeRow{
+      query.value(0).toInt(),
+      query.value(1).toString(),
+      query.value(2).toDouble(),
+      query.value(3).toDouble()
+    };
+  }
+
+  EstimateRow read_estimate(const QSqlQuery &query)
+  {
+    return EstimateRow{query.value(0).toInt(), query.value(1).toDouble(), query.value(2).toDouble()};
+  }
+
+  GroceryRow read_grocery(const QSqlQuery &query)
+  {
+    return GroceryRow{
+      query.value(0).toInt(),
+      query.value(1).toInt(),
+      query.value(2).toDouble(),
+      query.value(3).toInt()
+    };
+  }
+
+  FoodRow read_food(const QSqlQuery &query)
+  {
+    return FoodRow{
+      query.value(0).toInt(),
+      query.value(1).toString(),
+      query.value(2).toInt(),
+      query.value(3).toDouble(),
+      query.value(4)
+    };
+  }
+
+  IngredientRow read_ingredient(const QSqlQuery &query)
+  {
+    return IngredientRow{
+      query.value(0).toInt(),
+      query.value(1).toInt(),
+      query.value(2).toInt(),
+      query.value(3),
+      query.value(4).toDouble()
+    };
+  }
+}
+
+PlannedModel::PlannedModel(QObject *parent) :
+  RowModel(planned_columns, {"recipes"}, parent)
+{
+}
+
+void PlannedModel::set_costs(const CostEngine *costs_)
+{
+  costs = costs_;
+  reload();
+}
+
+void PlannedModel::repriced()
+{
+  if (!costs)
+    return;
+  change_rows([this](PlannedRow &row)
+  {
+    price(row);
+  });
+}
+
+QVariant PlannedModel::value(const PlannedRow &row, int column) const
+{
+  switch (column)
+  {
+    case 0:
+      return row.id;
+    case 1:
+      return row.name;
+    case 2:
+      return costs ? QVariant(row.marginal) : QVariant();
+    case 3:
+      return costs ? QVariant(row.shared) : QVariant();
+  }
+  return QVariant();
+}
+
+void PlannedModel::price(PlannedRow &row) const
+{
+  int index = costs->recipe_row(row.id);
+  row.marginal = index >= 0 ? costs->marginal(index) : 0;
+  row.shared = index >= 0 ? costs->shared(index) : 0;
+}
+
+void PlannedModel::fill(PlannedRow &row) const
+{
+  if (costs)
+    price(row);
+}
+
+PlannedModel::Queries PlannedModel::queries() const
+{
+  return Queries{
+    "select id, name from recipes where planned = 1 and id > :after order by id limit :limit;",
+    "select id, name from recipes where id in (%1) and planned = 1 order by id;",
+    read_planned
+  };
+}
+
+RecipesModel::RecipesModel(QObject *parent) :
+  RowModel(recipe_columns, {"recipes", "recipe_costs"}, parent)
+{
+}
+
+QVariant RecipesModel::value(const RecipeRow &row, int column) const
+{
+  switch (column)
+  {
+    case 0:
+      return row.id;
+    case 1:
+      return row.name;
+    case 2:
+      return row.staples;
+    case 3:
+      return row.fresh;
+  }
+  return QVariant();
+}
+
+void RecipesModel::set_costs(const CostEngine *costs_)
+{
+  costs = costs_;
+  reload();
+}
+
+void RecipesModel::repriced()
+{
+  if (!costs)
+    return;
+  change_rows([this](RecipeRow &row)
+  {
+    price(row);
+  });
+}
+
+void RecipesModel::price(RecipeRow &row) const
+{
+  int index = costs->recipe_row(row.id);
+  if (index >= 0)
+  {
+    row.staples = costs->staples(index);
+    row.fresh = costs->fresh(index);
+  }
+}
+
+void RecipesModel::fill(RecipeRow &row) const
+{
+  if (costs)
+    price(row);
+}
+
+RecipesModel::Queries RecipesModel::queries() const
+{
+  return Queries{
+    "select r.id, r.name, c.staples, c.fresh "
+    "from recipes r join recipe_costs c on c.recipe = r.id "
+    "where r.id > :after order by r.id limit :limit;",
+    "select r.id, r.name, c.staples, c.fresh "
+    "from recipes r join recipe_costs c on c.recipe = r.id where r.id in (%1) order by r.id;",
+    read_recipe
+  };
+}
+
+EstimatesModel::EstimatesModel(QObject *parent) :
+  RowModel(estimate_columns, {"grocery_totals"}, parent)
+{
+}
+
+QVariant EstimatesModel::value(const EstimateRow &row, int column) const
+{
+  switch (column)
+  {
+    case 0:
+      return row.staples + row.fresh;
+    case 1:
+      return row.staples;
+    case 2:
+      return row.fresh;
+  }
+  return QVariant();
+}
+
+EstimatesModel::Queries EstimatesModel::queries() const
+{
+  return Queries{
+    "select id, staples, fresh from grocery_totals where id > :after order by id limit :limit;",
+    "select id, staples, fresh from grocery_totals where id in (%1) order by id;",
+    read_estimate
+  };
+}
+
+GroceriesModel::GroceriesModel(QObject *parent) :
+  RowModel(grocery_columns, {"groceries"}, parent)
+{
+}
+
+QVariant GroceriesModel::value(const GroceryRow &row, int column) const
+{
+  switch (column)
+  {
+    case 0:
+      return row.id;
+    case 1:
+      return row.food;
+    case 2:
+      return row.quantity;
+    case 3:
+      return row.generated;
+  }
+  return QVariant();
+}
+
+GroceriesModel::Queries GroceriesModel::queries() const
+{
+  return Queries{
+    "select id, food, quantity, generated from groceries where id > :after order by id limit :limit;",
+    "select id, food, quantity, generated from groceries where id in (%1) order by id;",
+    read_grocery
+  };
+}
+
+bool GroceriesModel::editable(int column) const
+{
+  return column == 1 || column == 2;
+}
+
+bool GroceriesModel::write(int id, int column, const QVariant &value)
+{
+  return post_field("groceries", id, grocery_columns[column], value);
+}
+
+FoodsModel::FoodsModel(QObject *parent) :
+  RowModel(food_columns, {"foods"}, parent)
+{
+}
+
+QVariant FoodsModel::value(const FoodRow &row, int column) const
+{
+  switch (column)
+  {
+    case 0:
+      return row.id;
+    case 1:
+      return row.name;
+    case 2:
+      return row.staple;
+    case 3:
+      return row.price;
+    case 4:
+      return row.unit;
+  }
+  return QVariant();
+}
+
+FoodsModel::Queries FoodsModel::queries() const
+{
+  return Queries{
+    "select id, name, staple, price, unit from foods where id > :after order by id limit :limit;",
+    "select id, name, staple, price, unit from foods where id in (%1) order by id;",
+    read_food
+  };
+}
+
+bool FoodsModel::editable(int column) const
+{
+  return column > 0;
+}
+
+bool FoodsModel::write(int id, int column, const QVariant &value)
+{
+  return post_field("foods", id, food_columns[column], value);
+}
+
+IngredientsModel::IngredientsModel(QObject *parent) :
+  RowModel(ingredient_columns, {"ingredients"}, parent)
+{
+}
+
+void IngredientsModel::set_recipe(int id)
+{
+  recipe = id;
+  reload();
+}
+
+QVariant IngredientsModel::value(const IngredientRow &row, int column) const
+{
+  switch (column)
+  {
+    case 0:
+      return row.id;
+    case 1:
+      return row.recipe;
+    case 2:
+      return row.food;
+    case 3:
+      return row.unit;
+    case 4:
+      return row.quantity;
+  }
+  return QVariant();
+}
+
+IngredientsModel::Queries IngredientsModel::queries() const
+{
+  if (recipe < 0)
+    return Queries{QString(), QString(), read_ingredient};
+  return Queries{
+    QString(
+      "select id, recipe, food, unit, quantity from ingredients "
+      "where recipe = %1 and id > :after order by id limit :limit;").arg(recipe),
+    QString(
+      "select id, recipe, food, unit, quantity from ingredients "
+      "where recipe = %1 and id in (%2) order by id;").arg(recipe).arg("%1"),
+    read_ingredient
+  };
+}
+
+bool IngredientsModel::editable(int column) const
+{
+  return column >= 2;
+}
+
+bool IngredientsModel::write(int id, int column, const QVariant &value)
+{
+  return post_field("ingredients", id, ingredient_columns[column], value);
+}
+
+RecipeSearchModel::RecipeSearchModel(QObject *parent) : QAbstractTableModel(parent)
+{
+}
+
+int RecipeSearchModel::rowCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : matches.size();
+}
+
+int RecipeSearchModel::columnCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : search_columns.size();
+}
+
+QVariant RecipeSearchModel::data(const QModelIndex &index, int role) const
+{
+  if (!index.isValid() || role != Qt::DisplayRole)
+    return QVariant();
+  const DbRecipeMatch &match = matches[index.row()];
+  switch (index.column())
+  {
+    case 0:
+      return match.id;
+    case 1:
+      return match.name;
+    case 2:
+      return match.staples;
+    case 3:
+      return match.fresh;
+    case 4:
+      return match.snippet;
+  }
+  return QVariant();
+}
+
+QVariant RecipeSearchModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+  if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+    return search_columns.value(section);
+  return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+void RecipeSearchModel::search(QString text_)
+{
+  text = text_;
+  if (searching)
+  {
+    stale = true;
+    return;
+  }
+  searching = true;
+  QString term = text;
+  db_read<QList<DbRecipeMatch>>([term]()
+  {
+    return db_search_recipes(term);
+  },
+  this,
+  [this](QList<DbRecipeMatch> result)
+  {
+    searching = false;
+    // only the latest text's matches are shown
+    if (stale)
+    {
+      stale = false;
+      search(text);
+      return;
+    }
+    beginResetModel();
+    matches = result;
+    endResetModel();
+  });
+}
+
+void RecipeSearchModel::apply(const DbChanges &changes)
+{
+  if (text.isEmpty())
+    return;
+  for (auto source : search_sources)
+  {
+    if (changes.contains(source))
+    {
+      search(text);
+      return;
+    }
+  }
+}
+
+SuggestionsModel::SuggestionsModel(NameIndex *recipe_names_, QObject *parent) :
+  QAbstractTableModel(parent),
+  recipe_names(recipe_names_),
+  timer(new QTimer(this))
+{
+  timer->setSingleShot(true);
+  timer->setInterval(suggestion_delay_ms);
+  QObject::connect(timer, &QTimer::timeout, this, [this]()
+  {
+    refresh();
+  });
+}
+
+int SuggestionsModel::rowCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : suggestions.size();
+}
+
+int SuggestionsModel::columnCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : suggestion_columns.size();
+}
+
+QVariant SuggestionsModel::data(const QModelIndex &index, int role) const
+{
+  if (!index.isValid() || role != Qt::DisplayRole)
+    return QVariant();
+  const CostSuggestion &suggestion = suggestions[index.row()];
+  switch (index.column())
+  {
+    case 0:
+      return suggestion.id;
+    case 1:
+      return recipe_names->name(suggestion.id);
+    case 2:
+      return suggestion.cost;
+    case 3:
+      return suggestion.shared;
+  }
+  return QVariant();
+}
+
+QVariant SuggestionsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+  if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+    return suggestion_columns.value(section);
+  return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+void SuggestionsModel::set_costs(std::shared_ptr<const CostEngine> costs_)
+{
+  costs = costs_;
+  refresh();
+}
+
+void SuggestionsModel::refresh()
+{
+  if (!costs)
+    return;
+  if (refreshing)
+  {
+    stale = true;
+    return;
+  }
+  refreshing = true;
+  std::shared_ptr<const CostEngine> engine = costs;
+  db_read<QList<CostSuggestion>>([engine]()
+  {
+    return engine->suggest_ids(db_planned_recipes(), db_grocery_foods(), suggestion_limit);
+  },
+  this,
+  [this](QList<CostSuggestion> result)
+  {
+    beginResetModel();
+    suggestions = result;
+    endResetModel();
+    refreshing = false;
+    if (stale)
+    {
+      stale = false;
+      refresh();
+    }
+  });
+}
+
+void SuggestionsModel::apply(const DbChanges &changes)
+{
+  for (auto source : suggestion_sources)
+  {
+    if (changes.contains(source))
+    {
+      timer->start();
+      return;
+    }
+  }
+}
+
+void SuggestionsModel::repriced()
+{
+  timer->start();
+}
+
+ScenarioModel::ScenarioModel(NameIndex *recipe_names_, QObject *parent) :
+  QAbstractTableModel(parent),
+  recipe_names(recipe_names_)
+{
+}
+
+int ScenarioModel::rowCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : rows.size();
+}
+
+int ScenarioModel::columnCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : scenario_columns.size();
+}
+
+QVariant ScenarioModel::data(const QModelIndex &index, int role) const
+{
+  if (!index.isValid() || role != Qt::DisplayRole)
+    return QVariant();
+  const Row &row = rows[index.row()];
+  switch (index.column())
+  {
+    case 0:
+      return row.scenario;
+    case 1:
+      return row.recipe < 0 ? QVariant("(planned)") : QVariant(recipe_names->name(row.recipe));
+    case 2:
+      return row.base;
+    case 3:
+      return row.cost;
+    case 4:
+      return row.cost - row.base;
+  }
+  return QVariant();
+}
+
+QVariant ScenarioModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+  if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+    return scenario_columns.value(section);
+  return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+void ScenarioModel::set_results(const QList<ScenarioResult> &results)
+{
+  beginResetModel();
+  rows.clear();
+  for (auto result : results)
+  {
+    rows.append(Row{result.name, -1, result.plan_base, result.plan_cost});
+    for (auto recipe : result.recipes)
+      rows.append(Row{result.name, recipe.id, recipe.base, recipe.cost});
+  }
+  endResetModel();
+}
+
+TraceModel::TraceModel(QObject *parent) : QAbstractTableModel(parent)
+{
+}
+
+int TraceModel::rowCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : statements.size();
+}
+
+int TraceModel::columnCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : trace_columns.size();
+}
+
+QVariant TraceModel::data(const QModelIndex &index, int role) const
+{
+  if (!index.isValid() || role != Qt::DisplayRole)
+    return QVariant();
+  const DbStatementTrace &trace = statements[index.row()];
+  switch (index.column())
+  {
+    case 0:
+      return trace.sql;
+    case 1:
+      return trace.count;
+    case 2:
+      return QString::number(trace.total_ns / 1e6, 'f', 3);
+    case 3:
+      return QString::number(trace.total_ns / 1e6 / trace.count, 'f', 3);
+    case 4:
+      return QString::number(trace.max_ns / 1e6, 'f', 3);
+    case 5:
+      return trace.rows;
+    case 6:
+      return trace.slow;
+  }
+  return QVariant();
+}
+
+QVariant TraceModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+  if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+    return trace_columns.value(section);
+  return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+void TraceModel::refresh()
+{
+  beginResetModel();
+  statements = db_trace_statements();
+  endResetModel();
+}
@@ -0,0 +1,256 @@
+
+#ifndef models_h
+#define models_h
+
+#include "rowmodel.h"
+#include "dbtrace.h"
+#include "database.h"
+#include "scenario.h"
+#include "costengine.h"
+
+#include <memory>
+
+class NameIndex;
+class QTimer;
+
+struct PlannedRow
+{
+  int id;
+  QString name;
+  double marginal;
+  double shared;
+};
+
+struct RecipeRow
+{
+  int id;
+  QString name;
+  double staples;
+  double fresh;
+};
+
+struct EstimateRow
+{
+  int id;
+  double staples;
+  double fresh;
+};
+
+struct GroceryRow
+{
+  int id;
+  int food;
+  double quantity;
+  int generated;
+};
+
+struct FoodRow
+{
+  int id;
+  QString name;
+  int staple;
+  double price;
+  QVariant unit;
+};
+
+struct IngredientRow
+{
+  int id;
+  int recipe;
+  int food;
+  QVariant unit;
+  double quantity;
+};
+
+class PlannedModel : public RowModel<PlannedRow>
+{
+  public:
+    PlannedModel(QObject *parent = nullptr);
+
+    // Takes marginal and shared costs from costs; reloads
+    void set_costs(const CostEngine*);
+    // Reprices every row after costs is patched, since planning one recipe
+    // changes what the others share
+    void repriced();
+
+  protected:
+    QVariant value(const PlannedRow&, int) const override;
+    Queries queries() const override;
+    void fill(PlannedRow&) const override;
+
+  private:
+    const CostEngine *costs = nullptr;
+
+    void price(PlannedRow&) const;
+};
+
+class RecipesModel : public RowModel<RecipeRow>
+{
+  public:
+    RecipesModel(QObject *parent = nullptr);
+
+    // Takes costs from costs instead of recipe_costs; reloads
+    void set_costs(const CostEngine*);
+    // Reprices every row after costs is patched
+    void repriced();
+
+  protected:
+    QVariant value(const RecipeRow&, int) const override;
+    Queries queries() const override;
+    void fill(RecipeRow&) const override;
+
+  private:
+    const CostEngine *costs = nullptr;
+
+    void price(RecipeRow&) const;
+};
+
+class EstimatesModel : public RowModel<EstimateRow>
+{
+  public:
+    EstimatesModel(QObject *parent = nullptr);
+
+  protected:
+    QVariant value(const EstimateRow&, int) const override;
+    Queries queries() const override;
+};
+
+class GroceriesModel : public RowModel<GroceryRow>
+{
+  public:
+    GroceriesModel(QObject *parent = nullptr);
+
+  protected:
+    QVariant value(const GroceryRow&, int) const override;
+    Queries queries() const override;
+    bool editable(int) const override;
+    bool write(int, int, const QVariant&) override;
+};
+
+class FoodsModel : public RowModel<FoodRow>
+{
+  public:
+    FoodsModel(QObject *parent = nullptr);
+
+  protected:
+    QVariant value(const FoodRow&, int) const override;
+    Queries queries() const override;
+    bool editable(int) const override;
+    bool write(int, int, const QVariant&) override;
+};
+
+class IngredientsModel : public RowModel<IngredientRow>
+{
+  public:
+    IngredientsModel(QObject *parent = nullptr);
+
+    void set_recipe(int);
+
+  protected:
+    QVariant value(const IngredientRow&, int) const override;
+    Queries queries() const override;
+    bool editable(int) const override;
+    bool write(int, int, const QVariant&) override;
+
+  private:
+    int recipe = -1;
+};
+
+// Recipes matching a search, best match first, in RecipesModel's columns
+// followed by the matched text. Searches on a read thread, again when
+// recipes change.
+class RecipeSearchModel : public QAbstractTableModel
+{
+  public:
+    RecipeSearchModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int, Qt::Orientation, int role = Qt::DisplayRole) const override;
+
+    void search(QString);
+    void apply(const DbChanges&);
+
+  private:
+    QString text;
+    // a search is running, and text changed since it started
+    bool searching = false;
+    bool stale = false;
+    QList<DbRecipeMatch> matches;
+};
+
+// Unplanned recipes that reuse staples the plan or grocery list already
+// buys, cheapest to add first. Changes are coalesced into one refresh a
+// moment later, computed on a read thread; names come from recipe_names.
+class SuggestionsModel : public QAbstractTableModel
+{
+  public:
+    SuggestionsModel(NameIndex *recipe_names, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int, Qt::Orientation, int role = Qt::DisplayRole) const override;
+
+    void set_costs(std::shared_ptr<const CostEngine>);
+    void refresh();
+    void apply(const DbChanges&);
+    // Refreshes a moment later, after the cost engine is patched
+    void repriced();
+
+  private:
+    std::shared_ptr<const CostEngine> costs;
+    NameIndex *recipe_names;
+    QTimer *timer;
+    // a refresh is running, and another is due when it lands
+    bool refreshing = false;
+    bool stale = false;
+    QList<CostSuggestion> suggestions;
+};
+
+// Price scenario results, one row for each scenario's plan total followed
+// by its recipes; names come from recipe_names
+class ScenarioModel : public QAbstractTableModel
+{
+  public:
+    ScenarioModel(NameIndex *recipe_names, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int, Qt::Orientation, int role = Qt::DisplayRole) const override;
+
+    void set_results(const QList<ScenarioResult>&);
+
+  private:
+    struct Row
+    {
+      QString scenario;
+      // -1 for the plan total
+      int recipe;
+      double base;
+      double cost;
+    };
+    NameIndex *recipe_names;
+    QList<Row> rows;
+};
+
+// Snapshot of the statement trace, taken on refresh()
+class TraceModel : public QAbstractTableModel
+{
+  public:
+    TraceModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int, Qt::Orientation, int role = Qt::DisplayRole) const override;
+
+    void refresh();
+
+  private:
+    QList<DbStatementTrace> statements;
+};
+
+#endif
@@ -0,0 +1,264 @@
+
+#include "nameindex.h"
+#include "database.h"
+#include "dbworker.h"
+
+#include <QCompleter>
+#include <QHash>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
+
+namespace
+{
+  // ids per "in (...)" list
+  const int id_chunk = 500;
+
+  struct Entry
+  {
+    QString name;
+    int id;
+  };
+
+  bool entry_less(const Entry &a, const Entry &b)
+  {
+    int order = QString::compare(a.name, b.name, Qt::CaseInsensitive);
+    return order < 0 || (order == 0 && a.id < b.id);
+  }
+
+  // Every row of table in entry order
+  QVector<Entry> read_entries(QString table)
+  {
+    QVector<Entry> result;
+    QSqlQuery query(db_connection());
+    query.setForwardOnly(true);
+    if (query.exec(QString("select id, name from %1;").arg(table)))
+    {
+      while (query.next())
+        result.append(Entry{query.value(1).toString(), query.value(0).toInt()});
+    }
+    std::sort(result.begin(), result.end(), entry_less);
+    return result;
+  }
+
+  // Names of those of ids still in table
+  QHash<int, QString> read_names(QString table, QList<int> ids)
+  {
+    QHash<int, QString> result;
+    QSqlQuery query(db_connection());
+    query.setForwardOnly(true);
+    for (int first = 0; first < ids.size(); first += id_chunk)
+    {
+      QStringList chunk;
+      for (int id : ids.mid(first, id_chunk))
+        chunk.append(QString::number(id));
+      if (!query.exec(QString("select id, name from %1 where id in (%2);").arg(table).arg(chunk.join(','))))
+        break;
+      while (query.next())
+        result.insert(query.value(0).toInt(), query.value(1).toString());
+    }
+    return result;
+  }
+}
+
+struct NameIndex::Impl
+{
+  NameIndex *index;
+  QString table;
+  QVector<Entry> entries;
+  QHash<int, QString> names;
+  // names shared by several rows map to the lowest id
+  QHash<QString, int> ids;
+  // a read is out, and what is to be read after it; reads run through
+  // db_read one at a time so they land in order
+  bool reading = false;
+  bool reload_due = false;
+  QSet<qint64> refresh_due;
+
+  Impl(NameIndex *index_, QString table_) : index(index_), table(table_)
+  {
+  }
+
+  int position(const Entry &entry) const
+  {
+    return std::lower_bound(entries.begin(), entries.end(), entry, entry_less) - entries.begin();
+  }
+
+  void insert(int id, QString name)
+  {
+    Entry entry{name, id};
+    int row = position(entry);
+    index->beginInsertRows(QModelIndex(), row, row);
+    entries.insert(row, entry);
+    names.insert(id, name);
+    auto found = ids.find(name);
+    if (found == ids.end() || found.value() > id)
+      ids.insert(name, id);
+    index->endInsertRows();
+  }
+
+  void remove(int id)
+  {
+    auto found = names.constFind(id);
+    if (found == names.constEnd())
+      return;
+    QString name = found.value();
+    int row = position(Entry{name, id});
+    index->beginRemoveRows(QModelIndex(), row, row);
+    entries.remove(row);
+    names.remove(id);
+    if (ids.value(name, -1) == id)
+      relink(name, row);
+    index->endRemoveRows();
+  }
+
+  // points name at the next row still using it, if any, starting the search from row
+  void relink(QString name, int row)
+  {
+    ids.remove(name);
+    for (; row < entries.size() && QString::compare(entries[row].name, name, Qt::CaseInsensitive) == 0; row++)
+    {
+      if (entries[row].name == name)
+      {
+        ids.insert(name, entries[row].id);
+        return;
+      }
+    }
+  }
+
+  void refresh(int id, const QHash<int, QString> &loaded)
+  {
+    auto name = loaded.constFind(id);
+    auto found = names.constFind(id);
+    if (found != names.constEnd() && name != loaded.constEnd() && found.value() == name.value())
+      return;
+    remove(id);
+    if (name != loaded.constEnd())
+      insert(id, name.value());
+  }
+
+  void reset(const QVector<Entry> &loaded)
+  {
+    index->beginResetModel();
+    entries = loaded;
+    names.clear();
+    ids.clear();
+    for (int row = entries.size() - 1; row >= 0; row--)
+    {
+      names.insert(entries[row].id, entries[row].name);
+      ids.insert(entries[row].name, entries[row].id);
+    }
+    index->endResetModel();
+  }
+
+  // Starts the next read due, unless one is out
+  void next()
+  {
+    if (reading)
+      return;
+    QString from = table;
+    if (reload_due)
+    {
+      reload_due = false;
+      reading = true;
+      db_read<QVector<Entry>>([from]()
+      {
+        return read_entries(from);
+      },
+      index,
+      [this](QVector<Entry> loaded)
+      {
+        reading = false;
+        reset(loaded);
+        next();
+      });
+      return;
+    }
+    if (refresh_due.isEmpty())
+      return;
+    QList<int> changed;
+    for (qint64 id : refresh_due)
+      changed.append(int(id));
+    refresh_due.clear();
+    reading = true;
+    db_read<QHash<int, QString>>([from, changed]()
+    {
+      return read_names(from, changed);
+    },
+    index,
+    [this, changed](QHash<int, QString> loaded)
+    {
+      reading = false;
+      for (int id : changed)
+        refresh(id, loaded);
+      next();
+    });
+  }
+};
+
+NameIndex::NameIndex(QString table, QObject *parent) :
+  QAbstractListModel(parent),
+  impl(std::make_unique<Impl>(this, table))
+{
+  reload();
+}
+
+NameIndex::~NameIndex()
+{
+}
+
+int NameIndex::rowCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : impl->entries.size();
+}
+
+QVariant NameIndex::data(const QModelIndex &index, int role) const
+{
+  if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+    return QVariant();
+  return impl->entries[index.row()].name;
+}
+
+int NameIndex::id(QString name) const
+{
+  return impl->ids.value(name, -1);
+}
+
+QString NameIndex::name(int id) const
+{
+  return impl->names.value(id);
+}
+
+QCompleter *NameIndex::completer(QObject *parent)
+{
+  QCompleter *result = new QCompleter(this, parent);
+  result->setCompletionMode(QCompleter::InlineCompletion);
+  result->setCaseSensitivity(Qt::CaseInsensitive);
+  result->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
+  return result;
+}
+
+void NameIndex::reload()
+{
+  impl->reload_due = true;
+  impl->refresh_due.clear();
+  impl->next();
+}
+
+void NameIndex::apply(const DbChanges &changes)
+{
+  auto found = changes.constFind(impl->table);
+  if (found == changes.constEnd())
+    return;
+  const DbTableChanges &table = found.value();
+  if (table.reset)
+  {
+    reload();
+    return;
+  }
+  impl->refresh_due.unite(table.inserted);
+  impl->refresh_due.unite(table.updated);
+  impl->refresh_due.unite(table.deleted);
+  impl->next();
+}
@@ -0,0 +1,42 @@
+
+#ifndef nameindex_h
+#define nameindex_h
+
+#include "dbnotifier.h"
+
+#include <QAbstractListModel>
+#include <memory>
+
+class QCompleter;
+
+// The names of one table in case-insensitive order with hash lookups
+// between names and ids, kept current from database change notifications.
+// One instance per table is shared by every view, delegate and completer;
+// the sorted list and both hashes share each name's string data. Names are
+// read on a read thread and land a moment after the change.
+class NameIndex : public QAbstractListModel
+{
+  Q_OBJECT
+  public:
+    NameIndex(QString table, QObject *parent = nullptr);
+    ~NameIndex();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+
+    // -1 or an empty string when absent
+    int id(QString name) const;
+    QString name(int id) const;
+
+    QCompleter *completer(QObject *parent = nullptr);
+
+    // Replaces every name once the read lands
+    void reload();
+    void apply(const DbChanges&);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif
@@ -3,14 +3,15 @@
 #define nametoiddelegate_h
 
 #include <QStyledItemDelegate>
-#include <QMap>
 #include <memory>
 
+class NameIndex;
+
 class NameToIdDelegate : public QStyledItemDelegate
 {
   Q_OBJECT
   public:
-    NameToIdDelegate(QMap<QString, int> name_to_id, QObject *parent = nullptr);
+    NameToIdDelegate(NameIndex *names, QObject *parent = nullptr);
     ~NameToIdDelegate();
 
     QWidget* createEditor(QWidget*, const QStyleOptionViewItem&, const QModelIndex&) const override;
@@ -19,9 +20,6 @@ class NameToIdDelegate : public QStyledItemDelegate
     void updateEditorGeometry(QWidget*, const QStyleOptionViewItem&, const QModelIndex&) const override;
     QString displayText(const QVariant&, const QLocale&) const override;
 
-  public slots:
-    void reset(QMap<QString, int>);
-
   private:
     struct Impl;
     std::unique_ptr<Impl> impl;
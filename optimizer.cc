@@ -0,0 +1,415 @@
+
+#include "optimizer.h"
+#include "database.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const double epsilon = 1e-9;
+  // Leaving out one of the first split_depth candidates becomes a task any
+  // thread may steal; decisions past it stay on the deciding thread's stack
+  const int split_depth = 12;
+  // nodes a thread explores between looking at other threads' best plans
+  const int best_refresh = 256;
+
+  struct Candidate
+  {
+    int id;
+    double meals;
+    double fresh;
+    // indexes into Search::prices
+    std::vector<int> staples;
+  };
+
+  // Candidates before next are decided: those in chosen are in the plan
+  struct Task
+  {
+    int next;
+    std::vector<int> chosen;
+  };
+
+  struct Score
+  {
+    double meals;
+    int reuse;
+    double cost;
+  };
+
+  // More meals, then more staple reuse, then less cost
+  bool better(const Score &a, const Score &b)
+  {
+    if (a.meals > b.meals + epsilon)
+      return true;
+    if (a.meals < b.meals - epsilon)
+      return false;
+    if (a.reuse != b.reuse)
+      return a.reuse > b.reuse;
+    return a.cost < b.cost - epsilon;
+  }
+
+  // Depth-first branch and bound over candidates sorted by meals per fresh
+  // cost. Each thread keeps its tasks in a deque, taking the newest itself
+  // and stealing the oldest, largest subtrees from others when it runs out.
+  class Search
+  {
+    public:
+      Search(std::vector<Candidate> candidates_, std::vector<double> prices_, const PlanRequest &request_) :
+        candidates(std::move(candidates_)),
+        prices(std::move(prices_)),
+        request(request_)
+      {
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+        {
+          double left = a.meals * b.fresh;
+          double right = b.meals * a.fresh;
+          if (left != right)
+            return left > right;
+          if (a.meals != b.meals)
+            return a.meals > b.meals;
+          return a.id < b.id;
+        });
+        int count = candidates.size();
+        fresh_before.assign(count + 1, 0);
+        meals_before.assign(count + 1, 0);
+        staple_uses_after.assign(count + 1, 0);
+        for (int i = 0; i < count; i++)
+        {
+          fresh_before[i + 1] = fresh_before[i] + candidates[i].fresh;
+          meals_before[i + 1] = meals_before[i] + candidates[i].meals;
+        }
+        for (int i = count - 1; i >= 0; i--)
+          staple_uses_after[i] = staple_uses_after[i + 1] + int(candidates[i].staples.size());
+      }
+
+      PlanResult run(int threads)
+      {
+        for (int i = 0; i < threads; i++)
+        {
+          workers.emplace_back(new Worker());
+          workers.back()->uses.assign(prices.size(), 0);
+        }
+        push(*workers[0], Task{0, {}});
+
+        std::vector<QThread*> helpers;
+        for (int i = 1; i < threads; i++)
+        {
+          helpers.push_back(QThread::create([this, i]() { work(i); }));
+          helpers.back()->setObjectName("optimizer");
+          helpers.back()->start();
+        }
+        work(0);
+        for (auto helper : helpers)
+        {
+          helper->wait();
+          delete helper;
+        }
+
+        PlanResult result;
+        if (!best_chosen.empty())
+        {
+          result.cost = best.cost;
+          result.staple_reuse = best.reuse;
+        }
+        // the score caps meals at the request; report the plan's own
+        for (int index : best_chosen)
+        {
+          result.recipes.append(candidates[index].id);
+          result.meals += candidates[index].meals;
+        }
+        std::sort(result.recipes.begin(), result.recipes.end());
+        result.nodes = std::min<quint64>(nodes, request.max_nodes);
+        result.exhaustive = !truncated;
+        return result;
+      }
+
+    private:
+      struct Worker
+      {
+        QMutex mutex;
+        std::deque<Task> tasks;
+        // the plan being built
+        std::vector<int> uses;
+        std::vector<int> chosen;
+        double cost = 0;
+        double meals = 0;
+        int reuse = 0;
+        // copy of the shared best, refreshed every best_refresh nodes
+        Score best = {-1, 0, 0};
+        int since_refresh = 0;
+      };
+
+      std::vector<Candidate> candidates;
+      std::vector<double> prices;
+      PlanRequest request;
+      // sums over candidates before (or after) each index, for the bounds
+      std::vector<double> fresh_before;
+      std::vector<double> meals_before;
+      std::vector<int> staple_uses_after;
+
+      std::vector<std::unique_ptr<Worker>> workers;
+      // tasks queued or being explored
+      std::atomic<int> pending{0};
+      std::atomic<quint64> nodes{0};
+      std::atomic<bool> truncated{false};
+      // threads without tasks sleep here until one is pushed or none remain
+      QMutex idle_mutex;
+      QWaitCondition idle;
+      std::atomic<quint64> pushed{0};
+      QMutex best_mutex;
+      Score best = {-1, 0, 0};
+      std::vector<int> best_chosen;
+
+      // Fractional knapsack on fresh cost alone: no plan drawn from
+      // candidates from on can cover more meals with budget
+      double meals_bound(int from, double budget) const
+      {
+        double limit = fresh_before[from] + budget;
+        auto end = std::upper_bound(fresh_before.begin() + from, fresh_before.end(), limit + epsilon);
+        int whole = int(end - fresh_before.begin()) - 1;
+        double result = meals_before[whole] - meals_before[from];
+        if (whole < int(candidates.size()) && candidates[whole].fresh > 0)
+          result += candidates[whole].meals * (limit - fresh_before[whole]) / candidates[whole].fresh;
+        return result;
+      }
+
+      bool promising(const Worker &worker, int from) const
+      {
+        if (worker.best.meals < 0)
+          return true;
+        double bound = std::min(request.meals, worker.meals + meals_bound(from, request.budget - worker.cost));
+        if (bound < worker.best.meals - epsilon)
+          return false;
+        if (bound > worker.best.meals + epsilon)
+          return true;
+        int reuse_bound = worker.reuse + staple_uses_after[from];
+        if (reuse_bound != worker.best.reuse)
+          return reuse_bound > worker.best.reuse;
+        return worker.cost < worker.best.cost - epsilon;
+      }
+
+      // Cost of adding candidate index to the worker's plan
+      double added_cost(const Worker &worker, int index) const
+      {
+        const Candidate &candidate = candidates[index];
+        double result = candidate.fresh;
+        for (int staple : candidate.staples)
+        {
+          if (worker.uses[staple] == 0)
+            result += prices[staple];
+        }
+        return result;
+      }
+
+      void add(Worker &worker, int index, double cost)
+      {
+        const Candidate &candidate = candidates[index];
+        worker.cost += cost;
+        worker.meals += candidate.meals;
+        for (int staple : candidate.staples)
+        {
+          if (worker.uses[staple]++ > 0)
+            worker.reuse++;
+        }
+        worker.chosen.push_back(index);
+      }
+
+      void remove(Worker &worker, int index, double cost)
+      {
+        const Candidate &candidate = candidates[index];
+        worker.cost -= cost;
+        worker.meals -= candidate.meals;
+        for (int staple : candidate.staples)
+        {
+          if (--worker.uses[staple] > 0)
+            worker.reuse--;
+        }
+        worker.chosen.pop_back();
+      }
+
+      void record(Worker &worker)
+      {
+        Score score = {std::min(worker.meals, request.meals), worker.reuse, worker.cost};
+        if (!better(score, worker.best))
+          return;
+        QMutexLocker lock(&best_mutex);
+        if (better(score, best))
+        {
+          best = score;
+          best_chosen = worker.chosen;
+        }
+        worker.best = best;
+      }
+
+      void push(Worker &worker, Task task)
+      {
+        pending++;
+        {
+          QMutexLocker lock(&worker.mutex);
+          worker.tasks.push_back(std::move(task));
+        }
+        QMutexLocker lock(&idle_mutex);
+        pushed++;
+        idle.wakeOne();
+      }
+
+      void finish()
+      {
+        if (--pending > 0)
+          return;
+        QMutexLocker lock(&idle_mutex);
+        idle.wakeAll();
+      }
+
+      void explore(Worker &worker, int next)
+      {
+        for (int index = next; index < int(candidates.size()); index++)
+        {
+          if (truncated.load(std::memory_order_relaxed))
+            return;
+          if (nodes.fetch_add(1, std::memory_order_relaxed) >= request.max_nodes)
+          {
+            truncated = true;
+            return;
+          }
+          if (++worker.since_refresh >= best_refresh)
+          {
+            QMutexLocker lock(&best_mutex);
+            worker.best = best;
+            worker.since_refresh = 0;
+          }
+          // bounds only shrink as candidates are left out
+          if (!promising(worker, index))
+            return;
+
+          double cost = added_cost(worker, index);
+          if (worker.cost + cost > request.budget + epsilon)
+            continue;
+          bool split = index < split_depth;
+          if (split)
+            push(worker, Task{index + 1, worker.chosen});
+
+          add(worker, index, cost);
+          record(worker);
+          if (worker.meals < request.meals - epsilon)
+            explore(worker, index + 1);
+          remove(worker, index, cost);
+          if (split)
+            return;
+        }
+      }
+
+      bool take(int self, Task &task)
+      {
+        for (int i = 0; i < int(workers.size()); i++)
+        {
+          Worker &victim = *workers[(self + i) % workers.size()];
+          QMutexLocker lock(&victim.mutex);
+          if (victim.tasks.empty())
+            continue;
+          if (i == 0)
+          {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+          }
+          else
+          {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+          }
+          return true;
+        }
+        return false;
+      }
+
+      void work(int self)
+      {
+        Worker &worker = *workers[self];
+        Task task;
+        while (true)
+        {
+          quint64 seen = pushed;
+          if (!take(self, task))
+          {
+            QMutexLocker lock(&idle_mutex);
+            if (pending == 0)
+              return;
+            // a push since seen may be the task take missed
+            if (pushed == seen)
+              idle.wait(&idle_mutex);
+            continue;
+          }
+          std::vector<double> costs;
+          for (int index : task.chosen)
+          {
+            costs.push_back(added_cost(worker, index));
+            add(worker, index, costs.back());
+          }
+          explore(worker, task.next);
+          for (int i = int(task.chosen.size()) - 1; i >= 0; i--)
+            remove(worker, task.chosen[i], costs[i]);
+          finish();
+        }
+      }
+  };
+}
+
+PlanResult plan_optimize(const PlanRequest &request)
+{
+  QHash<int, double> staple_prices;
+  QList<DbPlanRecipe> recipes;
+  {
+    DbReader reader;
+    staple_prices = db_staple_prices();
+    recipes = db_plan_recipes();
+  }
+  QHash<int, int> staple_indexes;
+  std::vector<double> prices;
+  std::vector<Candidate> candidates;
+  for (auto recipe : recipes)
+  {
+    if (recipe.meals <= 0 || recipe.fresh > request.budget + epsilon)
+      continue;
+    Candidate candidate{recipe.id, recipe.meals, recipe.fresh, {}};
+    for (int food : recipe.staples)
+    {
+      auto found = staple_indexes.constFind(food);
+      if (found == staple_indexes.constEnd())
+      {
+        found = staple_indexes.insert(food, int(prices.size()));
+        prices.push_back(staple_prices.value(food));
+      }
+      candidate.staples.push_back(found.value());
+    }
+    candidates.push_back(std::move(candidate));
+  }
+
+  int threads = request.threads > 0 ? request.threads : std::max(1, QThread::idealThreadCount());
+  Search search(std::move(candidates), std::move(prices), request);
+  return search.run(threads);
+}
+
+bool plan_apply(const PlanResult &result)
+{
+  QSqlDatabase db = db_connection();
+  if (!db.transaction())
+    return false;
+  bool ok = db_clear_planned_groceries() && db_clear_planned();
+  for (int id : result.recipes)
+    ok = ok && db_add_planned(id);
+  if (!ok || !db_generate_planned_groceries() || !db_rebuild_grocery_totals())
+  {
+    db.rollback();
+    return false;
+  }
+  return db.commit();
+}
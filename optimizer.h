@@ -0,0 +1,43 @@
+
+#ifndef optimizer_h
+#define optimizer_h
+
+#include <QList>
+
+struct PlanRequest
+{
+  double budget = 0;
+  // meals past this earn nothing
+  double meals = 0;
+  // the search stops here and keeps the best plan found so far
+  quint64 max_nodes = 5000000;
+  // 0 runs one search thread per core
+  int threads = 0;
+};
+
+struct PlanResult
+{
+  QList<int> recipes;
+  // covered by the chosen recipes, which may pass the requested meals
+  double meals = 0;
+  double cost = 0;
+  // staple uses shared with another recipe in the plan
+  int staple_reuse = 0;
+  quint64 nodes = 0;
+  // false when max_nodes cut the search short
+  bool exhaustive = true;
+};
+
+// Picks recipes that cover the most meals up to request.meals within
+// request.budget, then reuse the most staples, then cost the least. Fresh
+// ingredients are paid per recipe and each staple once per plan, as
+// db_generate_planned_groceries buys them. Reads the catalog through a
+// DbReader.
+PlanResult plan_optimize(const PlanRequest&);
+
+// Replaces the meal plan with result's recipes and regenerates the
+// planned groceries and totals, in one transaction so a failure leaves
+// the plan as it was
+bool plan_apply(const PlanResult&);
+
+#endif
@@ -0,0 +1,130 @@
+
+#include "options.h"
+#include "database.h"
+#include "dbtrace.h"
+#include "importer.h"
+
+#include <cstdlib>
+
+namespace
+{
+  QString option_argument(int argc, char **argv, int i, const char *msg)
+  {
+    check_fatal(argc > i + 1, msg);
+    return argv[i + 1];
+  }
+}
+
+Options parse_options(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    QString arg(argv[i]);
+    if (arg == "--db")
+      options.db = option_argument(argc, argv, i++, "Missing argument for --db option");
+    else if (arg == "--import")
+      options.imports.append(option_argument(argc, argv, i++, "Missing argument for --import option"));
+    else if (arg == "--trace")
+      options.trace = true;
+    else if (arg == "--trace-slow")
+    {
+      bool ok;
+      options.trace_slow_ms = option_argument(argc, argv, i++, "Missing argument for --trace-slow option").toInt(&ok);
+      check_fatal(ok && options.trace_slow_ms >= 0, "Argument for --trace-slow option must be milliseconds");
+    }
+    else if (arg == "--trace-out")
+    {
+      options.trace_out = option_argument(argc, argv, i++, "Missing argument for --trace-out option");
+      options.trace = true;
+    }
+    else if (arg == "--profile")
+    {
+      options.profile = option_argument(argc, argv, i++, "Missing argument for --profile option");
+      check_fatal(
+          db_profile_names().contains(options.profile),
+          qPrintable("Argument for --profile option must be one of " + db_profile_names().join(", "))
+          );
+    }
+    else if (arg == "--maintain")
+      options.maintain = true;
+    else if (arg == "--headless")
+      options.headless = true;
+    else if (arg == "--clear-plan")
+      options.clear_plan = true;
+    else if (arg == "--plan")
+      options.plan.append(option_argument(argc, argv, i++, "Missing argument for --plan option"));
+    else if (arg == "--budget")
+    {
+      bool ok;
+      options.budget = option_argument(argc, argv, i++, "Missing argument for --budget option").toDouble(&ok);
+      check_fatal(ok && options.budget >= 0, "Argument for --budget option must be a non-negative amount");
+    }
+    else if (arg == "--meals")
+    {
+      bool ok;
+      options.meals = option_argument(argc, argv, i++, "Missing argument for --meals option").toDouble(&ok);
+      check_fatal(ok && options.meals > 0, "Argument for --meals option must be positive");
+    }
+    else if (arg == "--scenarios")
+      options.scenarios = option_argument(argc, argv, i++, "Missing argument for --scenarios option");
+    else if (arg == "--top")
+    {
+      bool ok;
+      options.top = option_argument(argc, argv, i++, "Missing argument for --top option").toInt(&ok);
+      check_fatal(ok && options.top >= 0, "Argument for --top option must be a non-negative count");
+    }
+    else if (arg == "--format")
+    {
+      options.format = option_argument(argc, argv, i++, "Missing argument for --format option");
+      check_fatal(
+          options.format == "text" || options.format == "csv" || options.format == "json",
+          "Argument for --format option must be text, csv or json"
+          );
+    }
+  }
+  return options;
+}
+
+void check_fatal(bool cond, const char *msg)
+{
+  if(!cond)
+  {
+    qCritical("%s\n", msg);
+    exit(-1);
+  }
+}
+
+void init_database(const Options &options)
+{
+  db_set_profile(options.profile);
+  check_fatal(db_init(options.db), "Unable to connect to or initialize database");
+  if (options.trace)
+  {
+    db_trace_set_slow_threshold(options.trace_slow_ms);
+    check_fatal(db_trace_attach(QSqlDatabase::database()), "Unable to trace database");
+  }
+  for (auto path : options.imports)
+  {
+    ImportStats stats;
+    bool ok = import_file(path, stats);
+    double seconds = qMax<qint64>(stats.msecs, 1) / 1000.0;
+    qInfo(
+        "Imported %lld rows (%lld skipped) from %s in %.2f s, %.0f rows/s",
+        stats.rows,
+        stats.skipped,
+        qPrintable(path),
+        seconds,
+        stats.rows / seconds
+        );
+    check_fatal(ok, "Unable to import file");
+  }
+}
+
+void finish_database(const Options &options)
+{
+  if (!options.trace_out.isEmpty() && !db_trace_write(options.trace_out))
+    qWarning("Unable to write trace to %s", qPrintable(options.trace_out));
+  db_trace_detach();
+  db_close();
+}
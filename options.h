@@ -0,0 +1,45 @@
+
+#ifndef options_h
+#define options_h
+
+#include <QString>
+#include <QStringList>
+
+struct Options
+{
+  QString db;
+  QStringList imports;
+  bool headless = false;
+  bool trace = false;
+  int trace_slow_ms = 100;
+  // trace written here as JSON on exit
+  QString trace_out;
+  // tuning pragmas, one of db_profile_names()
+  QString profile = "default";
+  // analyze and vacuum, report and exit
+  bool maintain = false;
+  // headless only
+  bool clear_plan = false;
+  QStringList plan;
+  // replaces the plan with the optimizer's when not negative
+  double budget = -1;
+  double meals = 14;
+  // price scenarios reported instead of the grocery list, with the top
+  // recipes by change in cost for each
+  QString scenarios;
+  int top = 20;
+  QString format = "text";
+};
+
+// Exits with a message on missing or invalid option arguments
+Options parse_options(int argc, char **argv);
+
+void check_fatal(bool cond, const char *msg);
+
+// Connects to options.db, starts tracing if asked and loads
+// options.imports, exiting on failure
+void init_database(const Options&);
+// Writes options.trace_out if set and closes the database
+void finish_database(const Options&);
+
+#endif
@@ -0,0 +1,363 @@
+
+#ifndef rowmodel_h
+#define rowmodel_h
+
+#include "dbnotifier.h"
+#include "dbworker.h"
+
+#include <QAbstractTableModel>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
+
+// Table model over typed rows kept in id order. Subclasses give the
+// statements rows are read with and write edits back to the database;
+// database change notifications then update, insert or remove only the
+// rows whose ids changed. Rows are fetched a page at a time, keyed on id,
+// as the view scrolls. Reads run through db_read one at a time, so their
+// results land in the order they were asked for.
+template <typename Row>
+class RowModel : public QAbstractTableModel
+{
+  public:
+    RowModel(QStringList headers_, QStringList sources_, QObject *parent = nullptr) :
+      QAbstractTableModel(parent),
+      headers(headers_),
+      sources(sources_)
+    {
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+      return parent.isValid() ? 0 : rows.size();
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+      return parent.isValid() ? 0 : headers.size();
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+      if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return QVariant();
+      return value(rows[index.row()], index.column());
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+      if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+        return headers.value(section);
+      return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    Qt::ItemFlags flags(const QModelIndex &index) const override
+    {
+      Qt::ItemFlags result = QAbstractTableModel::flags(index);
+      if (index.isValid() && editable(index.column()))
+        result |= Qt::ItemIsEditable;
+      return result;
+    }
+
+    // The stored row is updated when the change notification arrives
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override
+    {
+      if (!index.isValid() || role != Qt::EditRole || !editable(index.column()))
+        return false;
+      return write(rows[index.row()].id, index.column(), value);
+    }
+
+    bool canFetchMore(const QModelIndex &parent) const override
+    {
+      return !parent.isValid() && !complete;
+    }
+
+    void fetchMore(const QModelIndex &parent) override
+    {
+      if (parent.isValid() || complete)
+        return;
+      fetch_due = true;
+      next();
+    }
+
+    int id(int row) const
+    {
+      return rows[row].id;
+    }
+
+    // Replaces every row once the first page lands
+    void reload()
+    {
+      reload_due = true;
+      fetch_due = false;
+      refresh_due.clear();
+      next();
+    }
+
+    void apply(const DbChanges &changes)
+    {
+      QSet<qint64> ids;
+      for (auto source : sources)
+      {
+        auto found = changes.constFind(source);
+        if (found == changes.constEnd())
+          continue;
+        if (found.value().reset)
+        {
+          reload();
+          return;
+        }
+        ids.unite(found.value().inserted);
+        ids.unite(found.value().updated);
+        ids.unite(found.value().deleted);
+      }
+      if (ids.isEmpty())
+        return;
+      refresh_due.unite(ids);
+      next();
+    }
+
+  protected:
+    // Rewrites every loaded row in place, signalling the ones that changed
+    template <typename Change>
+    void change_rows(Change change)
+    {
+      for (int row = 0; row < rows.size(); row++)
+      {
+        Row changed = rows[row];
+        change(changed);
+        update(row, changed);
+      }
+    }
+
+    // Statements run on a read thread, so they are given as text rather
+    // than read through the model
+    struct Queries
+    {
+      // selects up to :limit rows with ids after :after, in id order; no
+      // rows when empty
+      QString page;
+      // selects the rows whose ids are listed in place of %1, in id order
+      QString ids;
+      Row (*read)(const QSqlQuery&);
+    };
+
+    virtual QVariant value(const Row&, int column) const = 0;
+    virtual Queries queries() const = 0;
+
+    // Fills in what rows take from the GUI thread, such as costs, as they land
+    virtual void fill(Row&) const
+    {
+    }
+
+    virtual bool editable(int) const
+    {
+      return false;
+    }
+
+    virtual bool write(int, int, const QVariant&)
+    {
+      return false;
+    }
+
+  private:
+    static const int page_size = 256;
+    // ids per "in (...)" list
+    static const int ids_chunk = 500;
+
+    QStringList headers;
+    QStringList sources;
+    QVector<Row> rows;
+    // false while rows past the last loaded id may remain unfetched
+    bool complete = true;
+    // a read is out, and what is to be read after it
+    bool reading = false;
+    bool reload_due = false;
+    bool fetch_due = false;
+    QSet<qint64> refresh_due;
+
+    static QVector<Row> read_page(Queries queries, int after)
+    {
+      QVector<Row> result;
+      if (queries.page.isEmpty())
+        return result;
+      QSqlQuery query(db_connection());
+      query.setForwardOnly(true);
+      if (!query.prepare(queries.page))
+        return result;
+      query.bindValue(":after", after);
+      query.bindValue(":limit", page_size);
+      if (!query.exec())
+        return result;
+      while (query.next())
+        result.append(queries.read(query));
+      return result;
+    }
+
+    // ids ascending
+    static QVector<Row> read_ids(Queries queries, QList<int> ids)
+    {
+      QVector<Row> result;
+      if (queries.ids.isEmpty())
+        return result;
+      QSqlQuery query(db_connection());
+      query.setForwardOnly(true);
+      for (int first = 0; first < ids.size(); first += ids_chunk)
+      {
+        QStringList chunk;
+        for (int id : ids.mid(first, ids_chunk))
+          chunk.append(QString::number(id));
+        if (!query.exec(queries.ids.arg(chunk.join(','))))
+          return result;
+        while (query.next())
+          result.append(queries.read(query));
+      }
+      return result;
+    }
+
+    QVector<Row> filled(QVector<Row> loaded) const
+    {
+      for (auto &row : loaded)
+        fill(row);
+      return loaded;
+    }
+
+    // Starts the next read due, unless one is out
+    void next()
+    {
+      if (reading)
+        return;
+      Queries from = queries();
+      if (reload_due)
+      {
+        reload_due = false;
+        reading = true;
+        db_read<QVector<Row>>([from]()
+        {
+          return read_page(from, -1);
+        },
+        this,
+        [this](QVector<Row> page)
+        {
+          reading = false;
+          beginResetModel();
+          rows = filled(page);
+          complete = rows.size() < page_size;
+          endResetModel();
+          next();
+        });
+        return;
+      }
+      if (!refresh_due.isEmpty())
+      {
+        // rows past the loaded window are picked up by a later fetch
+        QList<int> ids;
+        for (qint64 id : refresh_due)
+        {
+          if (complete || (!rows.isEmpty() && id <= rows.last().id))
+            ids.append(int(id));
+        }
+        refresh_due.clear();
+        if (!ids.isEmpty())
+        {
+          std::sort(ids.begin(), ids.end());
+          reading = true;
+          db_read<QVector<Row>>([from, ids]()
+          {
+            return read_ids(from, ids);
+          },
+          this,
+          [this, ids](QVector<Row> loaded)
+          {
+            reading = false;
+            refresh(ids, filled(loaded));
+            next();
+          });
+          return;
+        }
+      }
+      if (fetch_due)
+      {
+        fetch_due = false;
+        if (complete)
+          return;
+        int after = rows.isEmpty() ? -1 : rows.last().id;
+        reading = true;
+        db_read<QVector<Row>>([from, after]()
+        {
+          return read_page(from, after);
+        },
+        this,
+        [this](QVector<Row> page)
+        {
+          reading = false;
+          complete = page.size() < page_size;
+          if (!page.isEmpty())
+          {
+            beginInsertRows(QModelIndex(), rows.size(), rows.size() + page.size() - 1);
+            rows += filled(page);
+            endInsertRows();
+          }
+          next();
+        });
+      }
+    }
+
+    int position(int id) const
+    {
+      auto found = std::lower_bound(rows.begin(), rows.end(), id, [](const Row &row, int id)
+      {
+        return row.id < id;
+      });
+      return found - rows.begin();
+    }
+
+    // Updates, inserts or removes each of ids, ascending, as loaded holds it
+    void refresh(const QList<int> &ids, const QVector<Row> &loaded)
+    {
+      int next = 0;
+      for (int id : ids)
+      {
+        int row = position(id);
+        bool present = row < rows.size() && rows[row].id == id;
+        bool exists = next < loaded.size() && loaded[next].id == id;
+        if (exists && present)
+          update(row, loaded[next]);
+        else if (exists)
+        {
+          beginInsertRows(QModelIndex(), row, row);
+          rows.insert(row, loaded[next]);
+          endInsertRows();
+        }
+        else if (present)
+        {
+          beginRemoveRows(QModelIndex(), row, row);
+          rows.remove(row);
+          endRemoveRows();
+        }
+        if (exists)
+          next++;
+      }
+    }
+
+    void update(int row, const Row &fresh)
+    {
+      int first = -1;
+      int last = -1;
+      for (int column = 0; column < headers.size(); column++)
+      {
+        if (value(rows[row], column) != value(fresh, column))
+        {
+          if (first < 0)
+            first = column;
+          last = column;
+        }
+      }
+      rows[row] = fresh;
+      if (first >= 0)
+        emit dataChanged(index(row, first), index(row, last));
+    }
+};
+
+#endif
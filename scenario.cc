@@ -0,0 +1,211 @@
+
+#include "scenario.h"
+#include "costengine.h"
+#include "database.h"
+#include "importer.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  const double epsilon = 1e-9;
+  // scenarios costed per pass over the ingredients
+  const int batch = 32;
+  // fewer recipes than this per extra thread are not worth starting it for
+  const int rows_per_thread = 2048;
+
+  bool parse_amount(QString text, double &value)
+  {
+    bool ok;
+    value = text.toDouble(&ok);
+    return ok && value >= 0;
+  }
+
+  bool invalid(QString path, int record, const char *what)
+  {
+    qWarning("%s: bad %s in record %d", qPrintable(path), what, record);
+    return false;
+  }
+
+  // Writes scenario's price of every column to prices, stride apart
+  void fill_prices(const CostEngine &costs, const PriceScenario &scenario, double *prices, int stride)
+  {
+    const std::vector<double> &stored = costs.prices();
+    for (int column = 0; column < costs.food_count(); column++)
+    {
+      int id = costs.food_id(column);
+      double price = scenario.prices.value(id, stored[column]);
+      prices[size_t(column) * stride] = price * scenario.factors.value(id, 1) * scenario.factor;
+    }
+  }
+
+  // Calls work(first, count) over rows split evenly between threads, the
+  // first share on the calling thread
+  template <typename Work>
+  void split_rows(int rows, int threads, Work work)
+  {
+    int share = (rows + threads - 1) / threads;
+    std::vector<QThread*> helpers;
+    for (int first = share; first < rows; first += share)
+    {
+      helpers.push_back(QThread::create([=]() { work(first, share); }));
+      helpers.back()->setObjectName("scenarios");
+      helpers.back()->start();
+    }
+    work(0, share);
+    for (auto helper : helpers)
+    {
+      helper->wait();
+      delete helper;
+    }
+  }
+}
+
+bool read_scenarios(QString path, QList<PriceScenario> &scenarios)
+{
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+  {
+    qWarning("Could not open %s", qPrintable(path));
+    return false;
+  }
+  QTextStream in(&file);
+  QStringList header;
+  if (!read_csv_fields(in, header))
+    return invalid(path, 0, "header");
+  for (auto &name : header)
+    name = name.trimmed().toLower();
+  int scenario_column = header.indexOf("scenario");
+  int food_column = header.indexOf("food");
+  int price_column = header.indexOf("price");
+  int factor_column = header.indexOf("factor");
+  if (scenario_column < 0 || food_column < 0 || (price_column < 0 && factor_column < 0))
+  {
+    qWarning("%s: header needs scenario, food and price or factor", qPrintable(path));
+    return false;
+  }
+
+  QHash<QString, int> positions;
+  QStringList fields;
+  for (int record = 1; read_csv_fields(in, fields); record++)
+  {
+    auto field = [&](int column)
+    {
+      return column >= 0 && column < fields.size() ? fields[column].trimmed() : QString();
+    };
+    QString name = field(scenario_column);
+    QString food = field(food_column);
+    if (name.isEmpty() && food.isEmpty())
+      continue;
+
+    auto found = positions.constFind(name);
+    if (found == positions.constEnd())
+    {
+      found = positions.insert(name, scenarios.size());
+      scenarios.append(PriceScenario());
+      scenarios.last().name = name;
+    }
+    PriceScenario &scenario = scenarios[found.value()];
+
+    int id = -1;
+    if (food != "*")
+    {
+      id = db_food_id(food);
+      if (id < 0)
+        return invalid(path, record, "food");
+    }
+    double value;
+    if (!field(price_column).isEmpty())
+    {
+      if (id < 0 || !parse_amount(field(price_column), value))
+        return invalid(path, record, "price");
+      scenario.prices.insert(id, value);
+    }
+    if (!field(factor_column).isEmpty())
+    {
+      if (!parse_amount(field(factor_column), value))
+        return invalid(path, record, "factor");
+      if (id < 0)
+        scenario.factor *= value;
+      else
+        scenario.factors.insert(id, value);
+    }
+  }
+  return true;
+}
+
+QList<ScenarioResult> evaluate_scenarios(const CostEngine &costs, const QList<PriceScenario> &scenarios, const QList<int> &planned, int top)
+{
+  QList<ScenarioResult> results;
+  int recipes = costs.recipe_count();
+  int foods = costs.food_count();
+
+  QList<int> plan;
+  for (int id : planned)
+  {
+    int row = costs.recipe_row(id);
+    if (row >= 0)
+      plan.append(row);
+  }
+  double plan_staples;
+  double plan_fresh;
+  costs.plan_costs(plan, costs.prices().data(), 1, &plan_staples, &plan_fresh);
+  double plan_base = plan_staples + plan_fresh;
+
+  int threads = std::max(1, std::min(QThread::idealThreadCount(), recipes / rows_per_thread));
+  for (int first = 0; first < scenarios.size(); first += batch)
+  {
+    int count = std::min(batch, scenarios.size() - first);
+    std::vector<double> prices(size_t(foods) * count);
+    for (int s = 0; s < count; s++)
+      fill_prices(costs, scenarios[first + s], prices.data() + s, count);
+
+    std::vector<double> staples(size_t(recipes) * count);
+    std::vector<double> fresh(size_t(recipes) * count);
+    split_rows(recipes, threads, [&](int from, int rows)
+    {
+      costs.recipe_costs(prices.data(), count, staples.data(), fresh.data(), from, rows);
+    });
+    std::vector<double> totals_staples(count);
+    std::vector<double> totals_fresh(count);
+    costs.plan_costs(plan, prices.data(), count, totals_staples.data(), totals_fresh.data());
+
+    for (int s = 0; s < count; s++)
+    {
+      ScenarioResult result;
+      result.name = scenarios[first + s].name;
+      result.plan_base = plan_base;
+      result.plan_cost = totals_staples[s] + totals_fresh[s];
+
+      std::vector<RecipeDelta> changed;
+      for (int row = 0; row < recipes; row++)
+      {
+        double base = costs.staples(row) + costs.fresh(row);
+        size_t at = size_t(row) * count + s;
+        double cost = staples[at] + fresh[at];
+        if (std::abs(cost - base) > epsilon)
+          changed.push_back(RecipeDelta{costs.recipe_id(row), base, cost});
+      }
+      int kept = top < 0 ? int(changed.size()) : std::min(top, int(changed.size()));
+      std::partial_sort(changed.begin(), changed.begin() + kept, changed.end(), [](const RecipeDelta &a, const RecipeDelta &b)
+      {
+        double left = std::abs(a.cost - a.base);
+        double right = std::abs(b.cost - b.base);
+        if (left != right)
+          return left > right;
+        return a.id < b.id;
+      });
+      for (int i = 0; i < kept; i++)
+        result.recipes.append(changed[i]);
+      results.append(result);
+    }
+  }
+  return results;
+}
@@ -0,0 +1,49 @@
+
+#ifndef scenario_h
+#define scenario_h
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+class CostEngine;
+
+// What-if prices over the stored ones: a food costs its price here (or its
+// stored price), times its factor here, times factor
+struct PriceScenario
+{
+  QString name;
+  double factor = 1;
+  // by food id
+  QHash<int, double> prices;
+  QHash<int, double> factors;
+};
+
+struct RecipeDelta
+{
+  int id;
+  double base;
+  double cost;
+};
+
+struct ScenarioResult
+{
+  QString name;
+  // the planned recipes, bought as db_generate_planned_groceries buys them
+  double plan_base = 0;
+  double plan_cost = 0;
+  // largest change first
+  QList<RecipeDelta> recipes;
+};
+
+// Reads scenarios from a CSV file with a header row naming scenario, food and
+// price or factor; rows of one scenario need not be adjacent and a food of *
+// scales every price. Unknown foods and bad numbers fail the whole file.
+bool read_scenarios(QString path, QList<PriceScenario>&);
+
+// Costs every recipe and the given planned recipes under each scenario, a
+// batch of scenarios at a time across all cores, keeping the top recipes
+// whose cost changed
+QList<ScenarioResult> evaluate_scenarios(const CostEngine&, const QList<PriceScenario>&, const QList<int> &planned, int top);
+
+#endif
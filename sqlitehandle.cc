@@ -0,0 +1,44 @@
+
+#include "sqlitehandle.h"
+
+#include <QSqlDriver>
+#include <QSqlQuery>
+#include <QVariant>
+
+#include <sqlite3.h>
+
+namespace
+{
+  // Whether the driver's SQLite is the linked one. The source id names the
+  // exact build, so equal ids mean the plugin was built against this
+  // library rather than its own copy; every connection shares the plugin,
+  // so one check covers them all.
+  bool linked_library(QSqlDatabase db)
+  {
+    static const bool linked = [&]()
+    {
+      QSqlQuery query(db);
+      if (!query.exec("select sqlite_source_id();") || !query.next())
+        return false;
+      QString driver = query.value(0).toString();
+      if (driver != sqlite3_sourceid())
+      {
+        qWarning("QSQLITE runs SQLite %s, not the linked %s; configure Qt with -system-sqlite",
+            qPrintable(driver), sqlite3_sourceid());
+        return false;
+      }
+      return true;
+    }();
+    return linked;
+  }
+}
+
+sqlite3 *db_sqlite_handle(QSqlDatabase db)
+{
+  QVariant handle = db.driver()->handle();
+  if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0)
+    return nullptr;
+  if (!linked_library(db))
+    return nullptr;
+  return *static_cast<sqlite3**>(handle.data());
+}
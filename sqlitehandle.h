@@ -0,0 +1,16 @@
+
+#ifndef sqlitehandle_h
+#define sqlitehandle_h
+
+#include <QSqlDatabase>
+
+struct sqlite3;
+
+// The sqlite3 connection under an open QSQLITE database, for the hooks,
+// tracing and other calls Qt does not wrap. Null when the driver is not
+// SQLite or runs a different SQLite library than the one linked here,
+// such as the copy bundled into Windows and macOS builds of the plugin,
+// whose connections this library must not touch.
+sqlite3 *db_sqlite_handle(QSqlDatabase);
+
+#endif
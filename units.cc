@@ -0,0 +1,22 @@
+
+#include "units.h"
+
+#include <QStringList>
+
+QString unit_quantity_sql(QString quantity, QString from, QString to)
+{
+  // keys unit pairs as from * stride + to, with to running from 0
+  const int stride = unit_count + 1;
+  QStringList branches;
+  for (int i = 1; i <= unit_count; i++)
+  {
+    for (int j = 0; j <= unit_count; j++)
+    {
+      double factor = unit_factor(i, j);
+      if (factor != 1)
+        branches.append(QString("when %1 then %2").arg(i * stride + j).arg(factor, 0, 'g', 17));
+    }
+  }
+  return QString("%1 * coalesce(case %2 * %3 + coalesce(%4, 0) %5 end, 1)")
+    .arg(quantity).arg(from).arg(stride).arg(to).arg(branches.join(" "));
+}
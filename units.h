@@ -0,0 +1,66 @@
+
+#ifndef units_h
+#define units_h
+
+#include <QString>
+
+enum class UnitDimension
+{
+  volume,
+  mass
+};
+
+struct UnitDefinition
+{
+  const char *name;
+  UnitDimension dimension;
+  // milliliters or grams in one
+  double base;
+};
+
+// Seeded into the units table in this order, so a unit's id is its index
+// plus one. Only ever append, and recreate the triggers built from
+// unit_quantity_sql when you do.
+constexpr UnitDefinition unit_definitions[] = {
+  {"pinch", UnitDimension::volume, 0.308},
+  {"teaspoon", UnitDimension::volume, 4.92892},
+  {"tablespoon", UnitDimension::volume, 14.7868},
+  {"cup", UnitDimension::volume, 236.588},
+  {"quart", UnitDimension::volume, 946.353},
+  {"pint", UnitDimension::volume, 473.176},
+  {"gallon", UnitDimension::volume, 3785.41},
+  {"ounce", UnitDimension::mass, 28.3495},
+  {"pound", UnitDimension::mass, 453.592},
+};
+
+constexpr int unit_count = sizeof(unit_definitions) / sizeof(unit_definitions[0]);
+
+// Unit id that quantities of each dimension are summed in when their food
+// has no purchase unit, indexed by UnitDimension: cups and ounces
+constexpr int dimension_units[] = {4, 8};
+
+// Multiplier taking a quantity from one unit id to another, where unit 0
+// is the default unit of the quantity's dimension. Quantities without a
+// unit, or whose units measure different things, are taken as they are.
+constexpr double unit_factor(int from, int to)
+{
+  return from < 1 || from > unit_count
+    ? 1
+    : to == 0
+    ? unit_factor(from, dimension_units[int(unit_definitions[from - 1].dimension)])
+    : to < 1 || to > unit_count || unit_definitions[from - 1].dimension != unit_definitions[to - 1].dimension
+    ? 1
+    : unit_definitions[from - 1].base / unit_definitions[to - 1].base;
+}
+
+// SQL expression for quantity, in unit id from, converted to unit id to as
+// unit_factor does, with a null to taken as 0. The factors are literals
+// keyed on the pair of ids, so rows need no lookups.
+QString unit_quantity_sql(QString quantity, QString from, QString to);
+
+static_assert(unit_factor(4, 3) > 15.99 && unit_factor(4, 3) < 16.01, "16 tablespoons to the cup");
+static_assert(unit_factor(9, 8) > 15.99 && unit_factor(9, 8) < 16.01, "16 ounces to the pound");
+static_assert(unit_factor(4, 9) == 1, "no conversion between volume and mass");
+static_assert(unit_factor(3, 0) == unit_factor(3, 4), "tablespoons default to cups");
+
+#endif